@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "ansi.hpp"
+#include "profiler.hpp"
+
+// the longest escape, "\x1b[38;2;255;255;255m", and the character it colors
+static const size_t MAX_CELL_BYTES = 20;
+static const char RESET[] = "\x1b[0m";
+
+// the decimal digits of every byte value, so no escape goes through a string conversion
+struct DecimalTable
+{
+    char digits[256][3];
+    uint8_t length[256];
+};
+
+static DecimalTable build_decimal_table()
+{
+    DecimalTable table;
+    for (int value = 0; value < 256; ++value)
+    {
+        int length = (value >= 100) ? 3 : (value >= 10) ? 2 : 1;
+        for (int k = length - 1, rest = value; k >= 0; --k, rest /= 10)
+        {
+            table.digits[value][k] = static_cast<char>('0' + rest % 10);
+        }
+        table.length[value] = static_cast<uint8_t>(length);
+    }
+    return table;
+}
+
+static const DecimalTable &decimal_table()
+{
+    static const DecimalTable table = build_decimal_table();
+    return table;
+}
+
+// 5 bits per channel, as the delta encoder keeps them, so neighbouring cells of nearly the same color share an escape
+static inline int quantize_color(const cv::Vec3b &bgr)
+{
+    return ((bgr[2] >> 3) << 10) | ((bgr[1] >> 3) << 5) | (bgr[0] >> 3);
+}
+
+static inline int dequantize_channel(int channel)
+{
+    return (channel << 3) | (channel >> 2);
+}
+
+// xterm 256-color index nearest to the color of every quantized key: a level of the 6x6x6 cube or of the 24-step gray ramp
+static std::vector<uint8_t> build_palette_table()
+{
+    static const int CUBE_LEVELS[6] = {0, 95, 135, 175, 215, 255};
+    std::vector<uint8_t> table(1 << 15);
+
+    for (int key = 0; key < (1 << 15); ++key)
+    {
+        int rgb[3] = {dequantize_channel((key >> 10) & 31), dequantize_channel((key >> 5) & 31), dequantize_channel(key & 31)};
+
+        int cube[3];
+        int cube_distance = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            cube[c] = 0;
+            for (int level = 1; level < 6; ++level)
+            {
+                if (std::abs(CUBE_LEVELS[level] - rgb[c]) < std::abs(CUBE_LEVELS[cube[c]] - rgb[c]))
+                {
+                    cube[c] = level;
+                }
+            }
+            int error = CUBE_LEVELS[cube[c]] - rgb[c];
+            cube_distance += error * error;
+        }
+
+        // gray k of the ramp is 8 + 10k
+        int average = (rgb[0] + rgb[1] + rgb[2]) / 3;
+        int gray = std::min(23, std::max(0, (average - 3) / 10));
+        int gray_distance = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            int error = 8 + 10 * gray - rgb[c];
+            gray_distance += error * error;
+        }
+
+        table[key] = static_cast<uint8_t>(gray_distance < cube_distance ? 232 + gray : 16 + 36 * cube[0] + 6 * cube[1] + cube[2]);
+    }
+    return table;
+}
+
+static const std::vector<uint8_t> &palette_table()
+{
+    static const std::vector<uint8_t> table = build_palette_table();
+    return table;
+}
+
+AnsiMode parse_ansi_mode(const std::string &name)
+{
+    if (name == "truecolor" || name == "24bit")
+    {
+        return ANSI_TRUECOLOR;
+    }
+    if (name == "256")
+    {
+        return ANSI_256;
+    }
+    return ANSI_NONE;
+}
+
+static inline char *write_decimal(char *out, int value, const DecimalTable &decimals)
+{
+    std::memcpy(out, decimals.digits[value], 3);
+    return out + decimals.length[value];
+}
+
+// Write one line of cols cells at out and return its end. Every row starts without a color, so rows can be
+// encoded in any order.
+static char *encode_row(const char *line, const cv::Vec3b *colors, int cols, AnsiMode mode, char *out)
+{
+    const DecimalTable &decimals = decimal_table();
+    const uint8_t *palette = palette_table().data();
+
+    int current = -1;
+    for (int j = 0; j < cols; ++j)
+    {
+        // a space shows no foreground, so it neither needs nor breaks a run
+        if (line[j] != ' ')
+        {
+            int key = quantize_color(colors[j]);
+            int color = (mode == ANSI_256) ? palette[key] : key;
+            if (color != current)
+            {
+                current = color;
+                if (mode == ANSI_256)
+                {
+                    std::memcpy(out, "\x1b[38;5;", 7);
+                    out = write_decimal(out + 7, color, decimals);
+                }
+                else
+                {
+                    std::memcpy(out, "\x1b[38;2;", 7);
+                    out = write_decimal(out + 7, dequantize_channel((key >> 10) & 31), decimals);
+                    *out++ = ';';
+                    out = write_decimal(out, dequantize_channel((key >> 5) & 31), decimals);
+                    *out++ = ';';
+                    out = write_decimal(out, dequantize_channel(key & 31), decimals);
+                }
+                *out++ = 'm';
+            }
+        }
+        *out++ = line[j];
+    }
+    *out++ = '\n';
+    return out;
+}
+
+std::string encode_ansi(const char *text, const cv::Mat &cell_colors, AnsiMode mode, ThreadPool &pool)
+{
+    ScopedPhase phase(PHASE_ANSI);
+    const int rows = cell_colors.rows;
+    const int cols = cell_colors.cols;
+    const size_t slot_size = cols * MAX_CELL_BYTES + 1;
+
+    std::string out(rows * slot_size + sizeof(RESET) - 1, '\0');
+    std::vector<size_t> lengths(rows);
+    profile_count_allocation(out.size());
+
+    pool.parallel_for(0, rows, [&](int start_row, int end_row)
+                      {
+        for (int i = start_row; i < end_row; ++i)
+        {
+            char *slot = &out[i * slot_size];
+            lengths[i] = encode_row(text + static_cast<size_t>(i) * (cols + 1), cell_colors.ptr<cv::Vec3b>(i), cols, mode, slot) - slot;
+        } });
+
+    // pack the rows down to the front of the buffer
+    size_t packed = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        if (packed != i * slot_size)
+        {
+            std::memmove(&out[packed], &out[i * slot_size], lengths[i]);
+            profile_count_copy(lengths[i]);
+        }
+        packed += lengths[i];
+    }
+    std::memcpy(&out[packed], RESET, sizeof(RESET) - 1);
+    out.resize(packed + sizeof(RESET) - 1);
+    return out;
+}
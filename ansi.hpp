@@ -0,0 +1,27 @@
+#ifndef __ANSI_HPP__
+#define __ANSI_HPP__
+
+#include <string>
+#include <opencv2/opencv.hpp>
+
+#include "thread_pool.hpp"
+
+// Color escapes of the --ansi console output
+enum AnsiMode
+{
+    ANSI_NONE = 0,
+    ANSI_TRUECOLOR = 1, // 24-bit "38;2;r;g;b", quantized to 5 bits per channel
+    ANSI_256 = 2        // nearest entry of the xterm 6x6x6 color cube or gray ramp, "38;5;n"
+};
+
+// parse the argument of --ansi ("truecolor", "24bit" or "256"); returns ANSI_NONE for anything unknown
+AnsiMode parse_ansi_mode(const std::string &name);
+
+// Encode cell rows of text, cell_colors.rows lines of cell_colors.cols characters and a newline each, as
+// characters colored with the CV_8UC3 cell_colors (one pixel per cell). A color escape is only written
+// when the quantized color changes, and never for a space, so runs of similar cells share one escape.
+// Every row is encoded on its own by the threads of pool into a slot of one buffer sized for the worst
+// case, and the rows are then packed; the result ends by resetting the color.
+std::string encode_ansi(const char *text, const cv::Mat &cell_colors, AnsiMode mode, ThreadPool &pool);
+
+#endif // __ANSI_HPP__
@@ -0,0 +1,70 @@
+// Microbenchmark for the library API: independent conversions on threads sharing one Converter.
+// Usage: ./bench_converter [cols] [rows] [width] [max threads] [conversions per thread]
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "../converter.hpp"
+
+int main(int argc, char **argv)
+{
+    int cols = (argc > 1) ? std::atoi(argv[1]) : 1920;
+    int rows = (argc > 2) ? std::atoi(argv[2]) : 1080;
+    int width = (argc > 3) ? std::atoi(argv[3]) : 200;
+    int max_threads = (argc > 4) ? std::atoi(argv[4]) : static_cast<int>(std::thread::hardware_concurrency());
+    int conversions = (argc > 5) ? std::atoi(argv[5]) : 20;
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::RNG rng(12345);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+
+    ConverterConfig config;
+    config.colored_flag = true;
+    const Converter converter(config);
+
+    // every thread converts the same image on its own; the reference text checks they all agree
+    const std::string reference = converter.convert(image, width).first;
+
+    std::cout << "image: " << cols << "x" << rows << ", width " << width << ", " << conversions << " conversions per thread\n";
+    double single_rate = 0.0;
+    for (int num_threads = 1; num_threads <= std::max(1, max_threads); num_threads *= 2)
+    {
+        std::vector<int> mismatches(num_threads, 0);
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([&, t]
+                                 {
+                for (int i = 0; i < conversions; ++i)
+                {
+                    mismatches[t] += converter.convert(image, width).first != reference;
+                } });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double rate = num_threads * conversions / seconds;
+        if (num_threads == 1)
+        {
+            single_rate = rate;
+        }
+
+        int mismatched = 0;
+        for (int count : mismatches)
+        {
+            mismatched += count;
+        }
+        std::cout << num_threads << " threads: " << rate << " conversions/s (" << rate / single_rate << "x)"
+                  << (mismatched ? ", " + std::to_string(mismatched) + " MISMATCHED" : "") << "\n";
+    }
+
+    return 0;
+}
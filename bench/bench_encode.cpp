@@ -0,0 +1,107 @@
+// Microbenchmark for encoding the rendered ASCII image: cv::imencode versus the raster writer's PNG at
+// several deflate levels, PPM and QOI, on one thread and on a pool, over rendered images.
+// Usage: ./bench_encode [threads] [images...], every outputs/*_color.png by default
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "../raster_writer.hpp"
+#include "../thread_pool.hpp"
+#include "../utils.hpp"
+
+template <typename F>
+static double seconds(F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const std::string &name, double time, size_t raw_bytes, size_t encoded_bytes)
+{
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(9) << time * 1e3 << " ms " << std::setw(9) << raw_bytes / time / 1e6 << " MB/s "
+              << std::setw(12) << encoded_bytes << " bytes  ratio " << std::setprecision(2)
+              << static_cast<double>(raw_bytes) / encoded_bytes << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    int threads = (argc > 1) ? std::atoi(argv[1]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::string> files(argv + std::min(argc, 2), argv + argc);
+    if (files.empty())
+    {
+        std::vector<std::string> outputs;
+        get_image_files("outputs", outputs);
+        for (const std::string &file : outputs)
+        {
+            if (file.size() > 10 && file.compare(file.size() - 10, 10, "_color.png") == 0)
+            {
+                files.push_back(file);
+            }
+        }
+        std::sort(files.begin(), files.end());
+    }
+
+    ThreadPool single(1);
+    ThreadPool pool(threads);
+    for (const std::string &file : files)
+    {
+        cv::Mat image = cv::imread(file, cv::IMREAD_COLOR);
+        if (image.empty())
+        {
+            std::cerr << "Could not read " << file << "\n";
+            continue;
+        }
+        const size_t raw_bytes = image.total() * image.elemSize();
+        std::cout << file << ": " << image.cols << "x" << image.rows << ", " << raw_bytes << " raw bytes\n";
+
+        std::vector<uchar> encoded;
+        double time = seconds([&]
+                              { cv::imencode(".png", image, encoded); });
+        report("cv::imencode png", time, raw_bytes, encoded.size());
+
+        for (ThreadPool *p : {&single, &pool})
+        {
+            const std::string suffix = " x" + std::to_string(p->size());
+            for (int level : {0, 1, 6, 9})
+            {
+                RasterOptions options;
+                options.png_level = level;
+                time = seconds([&]
+                               { encoded = encode_raster(image, options, *p); });
+                report("png level " + std::to_string(level) + suffix, time, raw_bytes, encoded.size());
+
+                // the PNG must decode to the very same pixels
+                cv::Mat decoded = cv::imdecode(encoded, cv::IMREAD_COLOR);
+                bool same = decoded.rows == image.rows && decoded.cols == image.cols;
+                for (int i = 0; same && i < image.rows; i++)
+                {
+                    same = std::equal(image.ptr<uchar>(i), image.ptr<uchar>(i) + image.cols * 3, decoded.ptr<uchar>(i));
+                }
+                if (!same)
+                {
+                    std::cout << "  decoded PNG differs from the image\n";
+                }
+            }
+
+            RasterOptions options;
+            options.format = RASTER_PPM;
+            time = seconds([&]
+                           { encoded = encode_raster(image, options, *p); });
+            report("ppm" + suffix, time, raw_bytes, encoded.size());
+
+            options.format = RASTER_QOI;
+            time = seconds([&]
+                           { encoded = encode_raster(image, options, *p); });
+            report("qoi" + suffix, time, raw_bytes, encoded.size());
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
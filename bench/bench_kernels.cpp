@@ -0,0 +1,96 @@
+// Microbenchmark for the rendering kernels: the per-cell blit_glyph, with its color test on every glyph
+// row and the cell size read at run time, versus the row kernel the Converter selects, on real images.
+// Usage: ./bench_kernels [width] [images...], every images/*.png by default
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "../converter.hpp"
+#include "../utils.hpp"
+
+template <typename F>
+static double best_seconds(int repeats, F &&f)
+{
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    int width = (argc > 1) ? std::atoi(argv[1]) : 400;
+    std::vector<std::string> files(argv + std::min(argc, 2), argv + argc);
+    if (files.empty())
+    {
+        get_image_files("images", files);
+        std::sort(files.begin(), files.end());
+    }
+    const int repeats = 5;
+
+    for (const std::string &file : files)
+    {
+        cv::Mat image = cv::imread(file, cv::IMREAD_COLOR);
+        if (image.empty())
+        {
+            std::cerr << "Could not read " << file << "\n";
+            continue;
+        }
+
+        for (bool colored_flag : {false, true})
+        {
+            ConverterConfig config;
+            config.colored_flag = colored_flag;
+            const Converter converter(config);
+            const GlyphAtlas &atlas = converter.atlas();
+
+            cv::Mat cells;
+            cv::resize(image, cells, converter.grid_size(width, image.rows * width / image.cols));
+            std::vector<uint8_t> indices(cells.total());
+            for (int i = 0; i < cells.rows; ++i)
+            {
+                row_to_glyph_indices(cells.ptr<cv::Vec3b>(i), cells.cols, converter.lut(), &indices[static_cast<size_t>(i) * cells.cols]);
+            }
+
+            cv::Mat generic(cells.rows * atlas.cell_height, cells.cols * atlas.cell_width, CV_8UC3);
+            cv::Mat specialized(generic.size(), CV_8UC3);
+            double generic_time = best_seconds(repeats, [&]
+                                               {
+                for (int i = 0; i < cells.rows; ++i)
+                {
+                    for (int j = 0; j < cells.cols; ++j)
+                    {
+                        blit_glyph(generic, i, j, atlas, indices[static_cast<size_t>(i) * cells.cols + j], colored_flag, cells.at<cv::Vec3b>(i, j));
+                    }
+                } });
+            double kernel_time = best_seconds(repeats, [&]
+                                              {
+                for (int i = 0; i < cells.rows; ++i)
+                {
+                    converter.renderer().kernel(specialized, i, atlas, &indices[static_cast<size_t>(i) * cells.cols], cells.ptr<cv::Vec3b>(i), cells.cols);
+                } });
+
+            bool same = true;
+            for (int y = 0; y < generic.rows && same; ++y)
+            {
+                same = std::equal(generic.ptr<uchar>(y), generic.ptr<uchar>(y) + generic.cols * 3, specialized.ptr<uchar>(y));
+            }
+
+            const double num_cells = static_cast<double>(cells.total());
+            std::cout << std::left << std::setw(24) << file << std::setw(18) << converter.renderer().kernel_name << std::right << std::fixed
+                      << std::setprecision(1) << " generic " << std::setw(7) << num_cells / generic_time / 1e6 << " Mcells/s, kernel "
+                      << std::setw(7) << num_cells / kernel_time / 1e6 << " Mcells/s (" << std::setprecision(2) << generic_time / kernel_time << "x)"
+                      << (same ? "" : " MISMATCHED") << "\n";
+        }
+    }
+
+    return 0;
+}
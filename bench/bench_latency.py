@@ -0,0 +1,104 @@
+"""Latency benchmark for small, one-off conversions: times the whole process, startup included,
+of the shared-memory build (./out_local, make local) against the MPI build under mpirun -np 1,
+and writes the percentiles to bench/results/latency-<time>.json.
+
+Usage: python3 bench/bench_latency.py [--local ./out_local] [--binary ./out] [--mpirun "mpirun"]
+                                      [--image images/pikachu.png] [--width 80] [--repeats 20]
+"""
+import argparse
+import json
+import os
+import platform
+import shlex
+import shutil
+import statistics
+import subprocess
+import sys
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(BENCH_DIR)
+WORK_DIR = os.path.join(BENCH_DIR, "work")
+RESULTS_DIR = os.path.join(BENCH_DIR, "results")
+
+
+def time_run(command):
+    """Wall-clock seconds of one run of command, from spawn to exit."""
+    outputs = os.path.join(WORK_DIR, "outputs")
+    shutil.rmtree(outputs, ignore_errors=True)
+    os.makedirs(outputs)
+
+    start = time.perf_counter()
+    subprocess.run(command, cwd=WORK_DIR, check=True, stdout=subprocess.DEVNULL)
+    return time.perf_counter() - start
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def summarize(times):
+    return {"min": min(times), "p50": statistics.median(times), "p90": percentile(times, 0.9), "max": max(times)}
+
+
+def git_revision():
+    try:
+        return subprocess.run(["git", "rev-parse", "--short", "HEAD"], cwd=REPO_DIR, check=True,
+                              stdout=subprocess.PIPE, stderr=subprocess.DEVNULL).stdout.decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare the latency of the shared-memory and MPI builds")
+    parser.add_argument("--local", default=os.path.join(REPO_DIR, "out_local"))
+    parser.add_argument("--binary", default=os.path.join(REPO_DIR, "out"))
+    parser.add_argument("--mpirun", default=os.environ.get("MPIRUN", "mpirun"))
+    parser.add_argument("--image", default=os.path.join(REPO_DIR, "images", "pikachu.png"))
+    parser.add_argument("--width", type=int, default=80)
+    parser.add_argument("--threads", type=int, default=1)
+    parser.add_argument("--repeats", type=int, default=20)
+    args = parser.parse_args()
+
+    os.makedirs(WORK_DIR, exist_ok=True)
+    os.makedirs(RESULTS_DIR, exist_ok=True)
+
+    conversion = ["-i", os.path.abspath(args.image), "-o", "latency", "-w", str(args.width), "-t", str(args.threads)]
+    commands = {
+        "local": [os.path.abspath(args.local)] + conversion,
+        "mpirun_np1": shlex.split(args.mpirun) + ["-np", "1", os.path.abspath(args.binary)] + conversion,
+    }
+
+    results = {}
+    for name, command in commands.items():
+        # one untimed run so both builds start from a warm page cache
+        time_run(command)
+        results[name] = summarize([time_run(command) for _ in range(args.repeats)])
+        print("%-12s p50 %8.4f  p90 %8.4f  min %8.4f  max %8.4f" %
+              (name, results[name]["p50"], results[name]["p90"], results[name]["min"], results[name]["max"]))
+        sys.stdout.flush()
+    print("local is %.1fx faster at p50" % (results["mpirun_np1"]["p50"] / results["local"]["p50"]))
+
+    report = {
+        "revision": git_revision(),
+        "host": platform.node(),
+        "machine": platform.machine(),
+        "cpus": os.cpu_count(),
+        "mpirun": args.mpirun,
+        "image": os.path.relpath(os.path.abspath(args.image), REPO_DIR),
+        "width": args.width,
+        "threads": args.threads,
+        "repeats": args.repeats,
+        "unit": "seconds",
+        "runs": results,
+    }
+    results_path = os.path.join(RESULTS_DIR, time.strftime("latency-%Y%m%d-%H%M%S.json"))
+    with open(results_path, "w") as f:
+        json.dump(report, f, indent=2, sort_keys=True)
+    print("Results saved to %s" % results_path)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
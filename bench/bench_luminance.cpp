@@ -0,0 +1,71 @@
+// Microbenchmark for the luminance stage: float per-pixel math versus the fixed-point SIMD kernel.
+// Usage: ./bench_luminance [cols] [rows]
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "../constants.hpp"
+#include "../luminance.hpp"
+
+using namespace constants;
+
+template <typename F>
+static double seconds(F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    // 10000 is the width used by tests/template.sh
+    int cols = (argc > 1) ? std::atoi(argv[1]) : 10000;
+    int rows = (argc > 2) ? std::atoi(argv[2]) : 2000;
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::RNG rng(12345);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+
+    std::vector<uint8_t> reference(static_cast<size_t>(rows) * cols);
+    std::vector<uint8_t> indices(static_cast<size_t>(rows) * cols);
+    LuminanceLut lut = build_luminance_lut(DEFAULT_CHARACTERS.size(), false);
+
+    // the per-pixel float conversion process_image used before the lookup table
+    double float_time = seconds([&]
+                                {
+        for (int i = 0; i < rows; ++i)
+        {
+            for (int j = 0; j < cols; ++j)
+            {
+                cv::Vec3b pixel = image.at<cv::Vec3b>(i, j);
+                float gray = 0.299 * pixel[0] + 0.587 * pixel[1] + 0.114 * pixel[2];
+                reference[static_cast<size_t>(i) * cols + j] = static_cast<uint8_t>(gray * (DEFAULT_CHARACTERS.size() - 1) / 255);
+            }
+        } });
+
+    double simd_time = seconds([&]
+                               {
+        for (int i = 0; i < rows; ++i)
+        {
+            row_to_glyph_indices(image.ptr<cv::Vec3b>(i), cols, lut, &indices[static_cast<size_t>(i) * cols]);
+        } });
+
+    // fixed-point rounding can move a pixel sitting on a glyph boundary by one index
+    size_t off_by_one = 0, worse = 0;
+    for (size_t k = 0; k < indices.size(); ++k)
+    {
+        int delta = std::abs(static_cast<int>(indices[k]) - static_cast<int>(reference[k]));
+        off_by_one += (delta == 1);
+        worse += (delta > 1);
+    }
+
+    double bytes = static_cast<double>(rows) * cols * 3;
+    std::cout << "pixels: " << cols << "x" << rows << ", kernel: " << lut.kernel_name << "\n";
+    std::cout << "float:        " << bytes / float_time / 1e9 << " GB/s\n";
+    std::cout << "fixed-point:  " << bytes / simd_time / 1e9 << " GB/s (" << float_time / simd_time << "x)\n";
+    std::cout << "indices off by one: " << 100.0 * off_by_one / indices.size() << "%, off by more: " << worse << "\n";
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Microbenchmark for the cell rendering stage: per-cell cv::putText versus the glyph atlas.
+// Usage: ./bench_render [cols] [rows] [colored 0/1]
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+#include "../constants.hpp"
+#include "../glyph_atlas.hpp"
+
+using namespace constants;
+
+// the rendering loop process_image used before the glyph atlas
+static void render_put_text(const cv::Mat &image, cv::Mat &ascii_image, bool colored_flag)
+{
+    for (int i = 0; i < image.rows; i++)
+    {
+        for (int j = 0; j < image.cols; j++)
+        {
+            cv::Vec3b pixel = image.at<cv::Vec3b>(i, j);
+            float gray = 0.299 * pixel[0] + 0.587 * pixel[1] + 0.114 * pixel[2];
+            int index = static_cast<int>(gray * (DEFAULT_CHARACTERS.size() - 1) / 255);
+            cv::Scalar textColor = (colored_flag) ? cv::Scalar(pixel[0], pixel[1], pixel[2]) : cv::Scalar::all(255);
+            cv::putText(ascii_image, std::string(1, DEFAULT_CHARACTERS[index]), cv::Point(j * CHARACTER_WIDTH, i * CHARACTER_HEIGHT + CHARACTER_HEIGHT), cv::FONT_HERSHEY_SIMPLEX, 0.5, textColor, 1);
+        }
+    }
+}
+
+static void render_atlas(const cv::Mat &image, cv::Mat &ascii_image, const GlyphAtlas &atlas, bool colored_flag)
+{
+    for (int i = 0; i < image.rows; i++)
+    {
+        for (int j = 0; j < image.cols; j++)
+        {
+            cv::Vec3b pixel = image.at<cv::Vec3b>(i, j);
+            float gray = 0.299 * pixel[0] + 0.587 * pixel[1] + 0.114 * pixel[2];
+            int index = static_cast<int>(gray * (DEFAULT_CHARACTERS.size() - 1) / 255);
+            blit_glyph(ascii_image, i, j, atlas, index, colored_flag, pixel);
+        }
+    }
+}
+
+template <typename F>
+static double seconds(F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int cols = (argc > 1) ? std::atoi(argv[1]) : 1000;
+    int rows = (argc > 2) ? std::atoi(argv[2]) : 500;
+    bool colored_flag = (argc > 3) ? std::atoi(argv[3]) != 0 : true;
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::RNG rng(12345);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+
+    cv::Mat reference = cv::Mat::zeros(rows * CHARACTER_HEIGHT, cols * CHARACTER_WIDTH, CV_8UC3);
+    cv::Mat blitted = cv::Mat::zeros(rows * CHARACTER_HEIGHT, cols * CHARACTER_WIDTH, CV_8UC3);
+
+    GlyphAtlas atlas;
+    double atlas_time = seconds([&]
+                                { atlas = build_glyph_atlas(DEFAULT_CHARACTERS, CHARACTER_WIDTH, CHARACTER_HEIGHT); });
+    double put_text_time = seconds([&]
+                                   { render_put_text(image, reference, colored_flag); });
+    double blit_time = seconds([&]
+                               { render_atlas(image, blitted, atlas, colored_flag); });
+
+    // pixels that differ only because the atlas clips glyph overflow into neighbouring cells
+    cv::Mat diff;
+    cv::absdiff(reference, blitted, diff);
+    double mismatched = static_cast<double>(cv::countNonZero(diff.reshape(1))) / diff.reshape(1).total();
+
+    double cells = static_cast<double>(rows) * cols;
+    std::cout << "cells: " << cols << "x" << rows << (colored_flag ? " (color)" : "") << "\n";
+    std::cout << "atlas build:  " << atlas_time * 1e3 << " ms\n";
+    std::cout << "cv::putText:  " << cells / put_text_time << " cells/s\n";
+    std::cout << "glyph atlas:  " << cells / blit_time << " cells/s (" << put_text_time / blit_time << "x)\n";
+    std::cout << "mismatched bytes: " << mismatched * 100.0 << "%\n";
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+// Microbenchmark for shape matching: converting with --area by brightness versus --shape, and the
+// nearest-glyph search on its own, the scalar kernel against the vector one the CPU selects. It first checks
+// that flat cells keep the glyph of their brightness and that thin lines get the glyphs drawn like them, and
+// exits with 1 if either fails.
+// Usage: ./bench_shape [cols] [rows] [width] [threads]
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "../converter.hpp"
+
+template <typename F>
+static double seconds(F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the glyph of most cells of an image 10 cells wide
+static char common_glyph(const Converter &converter, const cv::Mat &image)
+{
+    std::map<char, int> counts;
+    for (char c : converter.convert(image, 10).first)
+    {
+        counts[c] += c != '\n';
+    }
+    char common = ' ';
+    for (const std::pair<const char, int> &count : counts)
+    {
+        common = (count.second > counts[common]) ? count.first : common;
+    }
+    return common;
+}
+
+// difference between the shapes of two glyphs of the charset
+static int shape_distance(const GlyphShapes &shapes, const std::string &characters, char a, char b)
+{
+    const uint8_t *fa = &shapes.features[characters.find(a) * SHAPE_FEATURES];
+    const uint8_t *fb = &shapes.features[characters.find(b) * SHAPE_FEATURES];
+    int distance = 0;
+    for (int k = 0; k < SHAPE_FEATURES; ++k)
+    {
+        distance += std::abs(fa[k] - fb[k]);
+    }
+    return distance;
+}
+
+// the sub-block where a glyph has the most ink
+static int strongest_sub_block(const GlyphShapes &shapes, const std::string &characters, char c)
+{
+    const uint8_t *feature = &shapes.features[characters.find(c) * SHAPE_FEATURES];
+    return static_cast<int>(std::max_element(feature, feature + SHAPE_FEATURES) - feature);
+}
+
+// Flat gray cells must give the same text with and without shapes, so the tone of --shape follows --area. Cells
+// crossed by a bright line where '|' or '-' has its stroke must get a glyph shaped like it, within a small shape
+// difference; by brightness alone they get whatever glyph their mean gray level falls on.
+static int check_shapes(const Converter &luminance, const Converter &shape)
+{
+    // cells of 40x72 pixels, 10x10 of them
+    const int cell_cols = 40, cell_rows = 72;
+    int flat_mismatched = 0;
+    for (int gray = 0; gray < 256; ++gray)
+    {
+        cv::Mat flat(10 * cell_rows, 10 * cell_cols, CV_8UC3, cv::Scalar::all(gray));
+        flat_mismatched += luminance.convert(flat, 10).first != shape.convert(flat, 10).first;
+    }
+    std::cout << "flat cells: " << flat_mismatched << " of 256 gray levels differ from --area\n";
+
+    const std::string &characters = shape.atlas().characters;
+    const int line_column = strongest_sub_block(shape.shapes(), characters, '|') % SHAPE_SIZE;
+    const int line_row = strongest_sub_block(shape.shapes(), characters, '-') / SHAPE_SIZE;
+    cv::Mat vertical(10 * cell_rows, 10 * cell_cols, CV_8UC3, cv::Scalar::all(0));
+    cv::Mat horizontal = vertical.clone();
+    for (int y = 0; y < vertical.rows; ++y)
+    {
+        for (int x = 0; x < vertical.cols; ++x)
+        {
+            if ((x % cell_cols) * SHAPE_SIZE / cell_cols == line_column)
+            {
+                vertical.at<cv::Vec3b>(y, x) = cv::Vec3b(255, 255, 255);
+            }
+            if ((y % cell_rows) * SHAPE_SIZE / cell_rows == line_row)
+            {
+                horizontal.at<cv::Vec3b>(y, x) = cv::Vec3b(255, 255, 255);
+            }
+        }
+    }
+
+    const int tolerance = SHAPE_FEATURES * 32;
+    int failed = flat_mismatched != 0;
+    const std::pair<const cv::Mat *, char> lines[] = {{&vertical, '|'}, {&horizontal, '-'}};
+    for (const std::pair<const cv::Mat *, char> &line : lines)
+    {
+        const char area_glyph = common_glyph(luminance, *line.first);
+        const char shape_glyph = common_glyph(shape, *line.first);
+        const int distance = shape_distance(shape.shapes(), characters, shape_glyph, line.second);
+        std::cout << (line.second == '|' ? "vertical" : "horizontal") << " line: '" << area_glyph << "' by brightness, '" << shape_glyph
+                  << "' by shape, " << distance << " from the shape of '" << line.second << "'\n";
+        failed += distance > tolerance;
+    }
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    int cols = (argc > 1) ? std::atoi(argv[1]) : 4000;
+    int rows = (argc > 2) ? std::atoi(argv[2]) : 3000;
+    int width = (argc > 3) ? std::atoi(argv[3]) : 1000;
+    int threads = (argc > 4) ? std::atoi(argv[4]) : 1;
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::RNG rng(12345);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+
+    ConverterConfig config;
+    config.area_flag = true;
+    const Converter luminance(config);
+    config.shape_flag = true;
+    const Converter shape(config);
+    const int failed = check_shapes(luminance, shape);
+
+    ThreadPool pool(threads);
+    cv::Size grid = luminance.grid_size(width, rows * width / cols);
+    double cells = static_cast<double>(grid.width) * grid.height;
+    std::cout << "image: " << cols << "x" << rows << ", grid " << grid.width << "x" << grid.height << ", " << threads << " threads\n";
+
+    std::pair<std::string, cv::Mat> output;
+    double luminance_time = seconds([&]
+                                    { output = luminance.convert(image, width, pool); });
+    double shape_time = seconds([&]
+                                { output = shape.convert(image, width, pool); });
+    std::cout << "luminance: " << cells / luminance_time << " cells/s\n";
+    std::cout << "shape:     " << cells / shape_time << " cells/s (" << shape_time / luminance_time << "x the time)\n";
+
+    // the search alone, on random shapes and tones
+    const GlyphShapes &shapes = shape.shapes();
+    const int searches = 1 << 20;
+    std::vector<uint8_t> targets(static_cast<size_t>(searches) * SHAPE_FEATURES);
+    cv::Mat target_mat(1, static_cast<int>(targets.size()), CV_8UC1, targets.data());
+    rng.fill(target_mat, cv::RNG::UNIFORM, 0, 256);
+    std::vector<uint8_t> grays(searches);
+    cv::Mat gray_mat(1, searches, CV_8UC1, grays.data());
+    rng.fill(gray_mat, cv::RNG::UNIFORM, 0, 256);
+
+    std::vector<int> reference(searches), vectorized(searches);
+    double scalar_time = seconds([&]
+                                 {
+        for (int i = 0; i < searches; ++i)
+        {
+            reference[i] = nearest_glyph_scalar(&targets[static_cast<size_t>(i) * SHAPE_FEATURES], SHAPE_TONE_WEIGHT * grays[i], shapes.features.data(), shapes.tones.data(), shapes.num_glyphs);
+        } });
+    double kernel_time = seconds([&]
+                                 {
+        for (int i = 0; i < searches; ++i)
+        {
+            vectorized[i] = shapes.kernel(&targets[static_cast<size_t>(i) * SHAPE_FEATURES], SHAPE_TONE_WEIGHT * grays[i], shapes.features.data(), shapes.tones.data(), shapes.num_glyphs);
+        } });
+
+    int mismatched = 0;
+    for (int i = 0; i < searches; ++i)
+    {
+        mismatched += reference[i] != vectorized[i];
+    }
+    std::cout << "search over " << shapes.num_glyphs << " glyphs, scalar: " << searches / scalar_time << " cells/s\n";
+    std::cout << "search over " << shapes.num_glyphs << " glyphs, " << shapes.kernel_name << ": " << searches / kernel_time << " cells/s ("
+              << scalar_time / kernel_time << "x), " << mismatched << " mismatched\n";
+
+    return failed ? 1 : 0;
+}
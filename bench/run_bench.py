@@ -0,0 +1,222 @@
+"""Local benchmark suite: runs the converter under mpirun over synthetic and bundled images
+across sizes, widths, charsets and rank/thread counts, and writes the --profile numbers of
+every configuration to bench/results/bench-<time>.json.
+
+With a baseline (bench/baseline.json, written by --save-baseline) every configuration's
+process (convert + render), gather and write (PNG + MPI-IO) times are checked against it and
+the script exits with status 1 if any of them got slower than the tolerance allows.
+
+Usage: python3 bench/run_bench.py [--binary ./out] [--mpirun "mpirun --oversubscribe"]
+                                  [--ranks 1,2,4] [--threads 1,2,4] [--repeats 3]
+                                  [--save-baseline] [--tolerance 1.25]
+"""
+import argparse
+import glob
+import json
+import os
+import platform
+import shlex
+import shutil
+import statistics
+import struct
+import subprocess
+import sys
+import time
+import zlib
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(BENCH_DIR)
+WORK_DIR = os.path.join(BENCH_DIR, "work")
+RESULTS_DIR = os.path.join(BENCH_DIR, "results")
+BASELINE_PATH = os.path.join(BENCH_DIR, "baseline.json")
+
+SHORT_CHARSET = " .:-=+*#%@"
+BINARY_CHARSET = " #"
+
+# a slowdown is only reported if it is also larger than this, so sub-millisecond phases do not flap
+SLACK_SECONDS = 0.002
+CHECKED_METRICS = ["process", "gather", "write"]
+
+
+def write_synthetic_png(path, width, height):
+    """Write a gradient-and-noise test card as an 8-bit RGB PNG using only the standard library."""
+    base = bytes(((x * 7) & 255, (x * 13 + 64) & 255, (x ^ (x >> 3)) & 255)[c] for x in range(width + 256) for c in range(3))
+    raw = bytearray()
+    for y in range(height):
+        shift = 3 * ((y * 5) % 256)
+        raw += b"\0" + base[shift:shift + 3 * width]
+
+    def chunk(tag, data):
+        return struct.pack(">I", len(data)) + tag + data + struct.pack(">I", zlib.crc32(tag + data) & 0xFFFFFFFF)
+
+    with open(path, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)))
+        f.write(chunk(b"IDAT", zlib.compress(bytes(raw), 1)))
+        f.write(chunk(b"IEND", b""))
+
+
+def synthetic_image(size):
+    path = os.path.join(WORK_DIR, "synthetic_%d.png" % size)
+    if not os.path.exists(path):
+        write_synthetic_png(path, size, size)
+    return path
+
+
+def build_matrix(ranks, threads):
+    """Every configuration of the suite as (group, image, width, charset, ranks, threads, options)."""
+    matrix = []
+    # strong scaling over ranks and threads
+    for r in ranks:
+        for t in threads:
+            matrix.append(("scaling", synthetic_image(2048), 400, None, r, t, ()))
+    # input size against output width
+    for size in (512, 2048, 4096):
+        for width in (100, 400, 1000):
+            matrix.append(("sizes", synthetic_image(size), width, None, ranks[-1], threads[0], ()))
+    # charset size changes the glyph table, not the work per cell
+    for charset in (None, SHORT_CHARSET, BINARY_CHARSET):
+        matrix.append(("charsets", synthetic_image(2048), 400, charset, ranks[-1], threads[0], ()))
+    # the bundled images
+    for image in sorted(glob.glob(os.path.join(REPO_DIR, "images", "*.png"))):
+        matrix.append(("images", image, 200, None, ranks[-1], threads[0], ()))
+    # glyphs by brightness after a resize, by brightness of the averaged block, and by shape
+    for options in ((), ("-a",), ("-m",)):
+        matrix.append(("modes", synthetic_image(4096), 1000, None, ranks[-1], threads[0], options))
+    return matrix
+
+
+def config_key(group, image, width, charset, num_ranks, num_threads, options):
+    charset_name = "default" if charset is None else "%d-chars" % len(charset)
+    key = "%s/%s/w%d/%s/np%d/t%d" % (group, os.path.basename(image), width, charset_name, num_ranks, num_threads)
+    return key + "".join("/" + option.lstrip("-") for option in options)
+
+
+def run_once(args, image, width, charset, num_ranks, num_threads, options):
+    """Run one conversion with --profile and return the max over ranks of every phase."""
+    outputs = os.path.join(WORK_DIR, "outputs")
+    shutil.rmtree(outputs, ignore_errors=True)
+    os.makedirs(outputs)
+
+    command = shlex.split(args.mpirun) + ["-np", str(num_ranks), args.binary, "-i", image, "-o", "bench",
+                                          "-w", str(width), "-c", "-t", str(num_threads), "-P"]
+    if charset is not None:
+        command += ["-s", charset]
+    command += list(options)
+    subprocess.run(command, cwd=WORK_DIR, check=True, stdout=subprocess.DEVNULL)
+
+    with open(os.path.join(outputs, "bench_profile.json")) as f:
+        profile = json.load(f)
+
+    phases = {name: stats["max"] for name, stats in profile["phases"].items()}
+    return {
+        "total": profile["total"]["max"],
+        "process": phases["convert"] + phases["render"],
+        "gather": phases["gather"],
+        "write": phases["png_encode"] + phases["mpi_io_write"],
+        "phases": phases,
+        "imbalance": {name: stats["imbalance"] for name, stats in profile["phases"].items()},
+    }
+
+
+def median_of(runs):
+    """Median of every metric over repeated runs of one configuration."""
+    result = {}
+    for metric in ("total", "process", "gather", "write"):
+        result[metric] = statistics.median(run[metric] for run in runs)
+    result["phases"] = {name: statistics.median(run["phases"][name] for run in runs) for name in runs[0]["phases"]}
+    result["imbalance"] = {name: statistics.median(run["imbalance"][name] for run in runs) for name in runs[0]["imbalance"]}
+    return result
+
+
+def check_regressions(results, baseline):
+    """Return a line for every checked metric that is slower than the baseline allows."""
+    tolerance = baseline.get("tolerance", 1.25)
+    slack = baseline.get("slack_seconds", SLACK_SECONDS)
+    regressions = []
+    for key, metrics in results.items():
+        reference = baseline["runs"].get(key)
+        if reference is None:
+            continue
+        for metric in baseline.get("metrics", CHECKED_METRICS):
+            limit = reference[metric] * tolerance + slack
+            if metrics[metric] > limit:
+                regressions.append("%s %s: %.4f s, baseline %.4f s (limit %.4f s)" % (key, metric, metrics[metric], reference[metric], limit))
+    return regressions
+
+
+def git_revision():
+    try:
+        return subprocess.run(["git", "rev-parse", "--short", "HEAD"], cwd=REPO_DIR, check=True,
+                              stdout=subprocess.PIPE, stderr=subprocess.DEVNULL).stdout.decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the local benchmark suite")
+    parser.add_argument("--binary", default=os.path.join(REPO_DIR, "out"))
+    parser.add_argument("--mpirun", default=os.environ.get("MPIRUN", "mpirun"))
+    parser.add_argument("--ranks", default="1,2,4")
+    parser.add_argument("--threads", default="1,2,4")
+    parser.add_argument("--repeats", type=int, default=3)
+    parser.add_argument("--save-baseline", action="store_true", help="write the results as bench/baseline.json")
+    parser.add_argument("--tolerance", type=float, default=1.25, help="allowed slowdown factor when saving a baseline")
+    args = parser.parse_args()
+
+    args.binary = os.path.abspath(args.binary)
+    ranks = [int(r) for r in args.ranks.split(",")]
+    threads = [int(t) for t in args.threads.split(",")]
+    os.makedirs(WORK_DIR, exist_ok=True)
+    os.makedirs(RESULTS_DIR, exist_ok=True)
+
+    results = {}
+    for group, image, width, charset, num_ranks, num_threads, options in build_matrix(ranks, threads):
+        key = config_key(group, image, width, charset, num_ranks, num_threads, options)
+        runs = [run_once(args, image, width, charset, num_ranks, num_threads, options) for _ in range(args.repeats)]
+        results[key] = median_of(runs)
+        print("%-55s total %8.4f  process %8.4f  gather %8.4f  write %8.4f" %
+              (key, results[key]["total"], results[key]["process"], results[key]["gather"], results[key]["write"]))
+        sys.stdout.flush()
+
+    report = {
+        "revision": git_revision(),
+        "host": platform.node(),
+        "machine": platform.machine(),
+        "cpus": os.cpu_count(),
+        "mpirun": args.mpirun,
+        "repeats": args.repeats,
+        "unit": "seconds",
+        "runs": results,
+    }
+    results_path = os.path.join(RESULTS_DIR, time.strftime("bench-%Y%m%d-%H%M%S.json"))
+    with open(results_path, "w") as f:
+        json.dump(report, f, indent=2, sort_keys=True)
+    print("Results saved to %s" % results_path)
+
+    if args.save_baseline:
+        baseline = {"tolerance": args.tolerance, "slack_seconds": SLACK_SECONDS, "metrics": CHECKED_METRICS,
+                    "revision": report["revision"], "host": report["host"],
+                    "runs": {key: {metric: metrics[metric] for metric in CHECKED_METRICS} for key, metrics in results.items()}}
+        with open(BASELINE_PATH, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+        print("Baseline saved to %s" % BASELINE_PATH)
+        return 0
+
+    if not os.path.exists(BASELINE_PATH):
+        print("No baseline at %s, skipping the regression check (make bench-baseline writes one)" % BASELINE_PATH)
+        return 0
+
+    with open(BASELINE_PATH) as f:
+        baseline = json.load(f)
+    regressions = check_regressions(results, baseline)
+    for line in regressions:
+        print("REGRESSION " + line)
+    if regressions:
+        return 1
+    print("No regressions against the baseline from revision %s" % baseline.get("revision", "unknown"))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,92 @@
+#ifndef __BOUNDED_QUEUE_HPP__
+#define __BOUNDED_QUEUE_HPP__
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Blocking FIFO between two pipeline stages. push waits while the queue is full and pop waits
+// while it is empty, so a slow stage throttles the ones before it instead of buffering everything.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    // returns false if the queue was closed before the item could be added
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [&]
+                      { return closed || items.size() < capacity; });
+        if (closed)
+        {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        ++pushes;
+        depth_sum += items.size();
+        max_depth = std::max(max_depth, items.size());
+        not_empty.notify_one();
+        return true;
+    }
+
+    // returns false once the queue is closed and drained
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&]
+                       { return closed || !items.empty(); });
+        if (items.empty())
+        {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    // no more items will be pushed; wakes up every waiting consumer
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    size_t get_capacity() const { return capacity; }
+
+    size_t get_max_depth()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return max_depth;
+    }
+
+    // average number of queued items, sampled every time an item is pushed
+    double get_mean_depth()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pushes ? static_cast<double>(depth_sum) / pushes : 0.0;
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool closed = false;
+
+    size_t pushes = 0;
+    size_t depth_sum = 0;
+    size_t max_depth = 0;
+};
+
+#endif // __BOUNDED_QUEUE_HPP__
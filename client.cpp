@@ -0,0 +1,300 @@
+// Client and load generator for the conversion daemon (./out --listen <SOCKET>).
+// Sends one job and prints the text and/or saves the PNG, or with -N sends many jobs from -C
+// concurrent connections and reports throughput and p50/p99 latency as seen by the clients.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "daemon_protocol.hpp"
+
+static void show_client_usage(const std::string &executable_name)
+{
+    std::cerr << "Usage: " << executable_name << " -l <SOCKET> [options]\n\n";
+    std::cerr << "Options:\n"
+                 "  -l, --listen <SOCKET>    Socket the daemon listens on (required)\n"
+                 "  -i, --input  <FILE>      Image to convert; the daemon reads it unless -b is given\n"
+                 "  -b, --bytes              Send the image file's bytes instead of its path\n"
+                 "  -w, --width  <INT>       Width of the ASCII output\n"
+                 "  -s, --chars  <STRING>    Characters of the ASCII output\n"
+                 "  -f, --factor <FLOAT>     Scale factor from 0.1 to 1.0\n"
+                 "  -c, --color              Colored PNG\n"
+                 "  -n, --negate             Negative ASCII art\n"
+                 "  -r, --rec601             Rec.601 luminance weights\n"
+                 "  -a, --area               Average each cell's block of source pixels\n"
+                 "  -m, --shape              Pick characters by the shape of each cell's pixels; implies -a\n"
+                 "  -o, --output <FILE>      Also ask for the PNG and save it to FILE\n"
+                 "  -q, --quiet              Do not ask for or print the text\n"
+                 "  -N, --requests <INT>     Load test: send INT jobs and report the latency percentiles\n"
+                 "  -C, --concurrency <INT>  Load test: connections sending jobs at the same time, default 1\n"
+                 "      --stats              Print the daemon's latency percentiles\n"
+                 "      --shutdown           Stop the daemon\n\n";
+    std::cerr << "Example: '" << executable_name << " -l /tmp/ascii.sock -i images/hwoarang.png -w 90 -c -o hwoarang.png'\n\n";
+}
+
+static bool read_file(const std::string &path, std::vector<unsigned char> &bytes)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// send one job on a new connection and wait for its reply
+static bool request_once(const std::string &socket_path, const DaemonJob &job, DaemonReply &reply)
+{
+    int fd = connect_daemon(socket_path);
+    if (fd < 0)
+    {
+        std::cerr << "Error: Could not connect to " << socket_path << "\n";
+        return false;
+    }
+    bool answered = send_job(fd, job) && recv_reply(fd, reply);
+    close(fd);
+    if (!answered)
+    {
+        std::cerr << "Error: The daemon closed the connection\n";
+    }
+    return answered;
+}
+
+// -C connections each send their share of -N jobs one after the other, timing every round trip
+static int run_load(const std::string &socket_path, const DaemonJob &job, int num_requests, int concurrency)
+{
+    std::vector<std::vector<double>> latencies(concurrency);
+    std::atomic<int> next(0);
+    std::atomic<int> failed(0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < concurrency; ++c)
+    {
+        clients.emplace_back([&, c]
+                             {
+            int fd = connect_daemon(socket_path);
+            if (fd < 0)
+            {
+                ++failed;
+                return;
+            }
+            DaemonReply reply;
+            while (next++ < num_requests)
+            {
+                auto sent = std::chrono::steady_clock::now();
+                if (!send_job(fd, job) || !recv_reply(fd, reply))
+                {
+                    ++failed;
+                    break;
+                }
+                latencies[c].push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - sent).count());
+                failed += !reply.ok;
+            }
+            close(fd); });
+    }
+    for (std::thread &client : clients)
+    {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const std::vector<double> &client : latencies)
+    {
+        all.insert(all.end(), client.begin(), client.end());
+    }
+    if (all.empty())
+    {
+        std::cerr << "Error: No job was answered\n";
+        return EXIT_FAILURE;
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double fraction)
+    {
+        return all[std::min(all.size() - 1, static_cast<size_t>(fraction * all.size()))] * 1e3;
+    };
+
+    std::cout << all.size() << " jobs from " << concurrency << " connections in " << seconds << " s: "
+              << all.size() / seconds << " jobs/s, " << failed << " failed\n";
+    std::cout << "client latency: p50 " << percentile(0.50) << " ms, p99 " << percentile(0.99) << " ms, max " << all.back() * 1e3 << " ms\n";
+
+    DaemonJob stats;
+    stats.flags = JOB_STATS;
+    DaemonReply reply;
+    if (request_once(socket_path, stats, reply))
+    {
+        std::cout << "daemon latency: " << reply.text;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    enum
+    {
+        OPTION_STATS = CHAR_MAX + 1,
+        OPTION_SHUTDOWN
+    };
+    struct option long_options[] = {
+        {"listen", required_argument, nullptr, 'l'},
+        {"input", required_argument, nullptr, 'i'},
+        {"bytes", no_argument, nullptr, 'b'},
+        {"width", required_argument, nullptr, 'w'},
+        {"chars", required_argument, nullptr, 's'},
+        {"factor", required_argument, nullptr, 'f'},
+        {"color", no_argument, nullptr, 'c'},
+        {"negate", no_argument, nullptr, 'n'},
+        {"rec601", no_argument, nullptr, 'r'},
+        {"area", no_argument, nullptr, 'a'},
+        {"shape", no_argument, nullptr, 'm'},
+        {"output", required_argument, nullptr, 'o'},
+        {"quiet", no_argument, nullptr, 'q'},
+        {"requests", required_argument, nullptr, 'N'},
+        {"concurrency", required_argument, nullptr, 'C'},
+        {"stats", no_argument, nullptr, OPTION_STATS},
+        {"shutdown", no_argument, nullptr, OPTION_SHUTDOWN},
+        {0, 0, 0, 0}};
+
+    std::string socket_path, input_filepath, output_filepath;
+    bool bytes_flag = false;
+    bool quiet_flag = false;
+    int num_requests = 0;
+    int concurrency = 1;
+    DaemonJob job;
+    job.flags = 0;
+
+    int option;
+    while ((option = getopt_long(argc, argv, "l:i:bw:s:f:cnramo:qN:C:", long_options, nullptr)) != EOF)
+    {
+        switch (option)
+        {
+        case 'l':
+            socket_path = optarg;
+            break;
+        case 'i':
+            input_filepath = optarg;
+            break;
+        case 'b':
+            bytes_flag = true;
+            break;
+        case 'w':
+            job.width = std::atoi(optarg);
+            break;
+        case 's':
+            job.characters = optarg;
+            break;
+        case 'f':
+            job.scale_factor = std::atof(optarg);
+            break;
+        case 'c':
+            job.flags |= JOB_COLOR;
+            break;
+        case 'n':
+            job.flags |= JOB_NEGATE;
+            break;
+        case 'r':
+            job.flags |= JOB_REC601;
+            break;
+        case 'a':
+            job.flags |= JOB_AREA;
+            break;
+        case 'm':
+            job.flags |= JOB_SHAPE;
+            break;
+        case 'o':
+            output_filepath = optarg;
+            break;
+        case 'q':
+            quiet_flag = true;
+            break;
+        case 'N':
+            num_requests = std::atoi(optarg);
+            break;
+        case 'C':
+            concurrency = std::max(1, std::atoi(optarg));
+            break;
+        case OPTION_STATS:
+            job.flags |= JOB_STATS;
+            break;
+        case OPTION_SHUTDOWN:
+            job.flags |= JOB_SHUTDOWN;
+            break;
+        default:
+            show_client_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (socket_path.empty() || (input_filepath.empty() && !(job.flags & (JOB_STATS | JOB_SHUTDOWN))))
+    {
+        show_client_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!input_filepath.empty())
+    {
+        if (bytes_flag)
+        {
+            if (!read_file(input_filepath, job.image_bytes))
+            {
+                std::cerr << "Error: Could not read " << input_filepath << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            // the daemon may run in another directory
+            char *absolute = realpath(input_filepath.c_str(), nullptr);
+            job.path = absolute ? absolute : input_filepath;
+            free(absolute);
+        }
+    }
+    if (!quiet_flag)
+    {
+        job.flags |= JOB_WANT_TEXT;
+    }
+    if (!output_filepath.empty())
+    {
+        job.flags |= JOB_WANT_PNG;
+    }
+
+    if (num_requests > 0)
+    {
+        return run_load(socket_path, job, num_requests, concurrency);
+    }
+
+    DaemonReply reply;
+    if (!request_once(socket_path, job, reply))
+    {
+        return EXIT_FAILURE;
+    }
+    if (!reply.ok)
+    {
+        std::cerr << "Error: " << reply.text << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << reply.text;
+    if (!output_filepath.empty())
+    {
+        std::ofstream png(output_filepath, std::ios::binary);
+        png.write(reinterpret_cast<const char *>(reply.png.data()), reply.png.size());
+        if (!png)
+        {
+            std::cerr << "Error: Could not write " << output_filepath << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#ifndef __COMM_HPP__
+#define __COMM_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// The handful of collective operations the converter needs. The default build runs them on MPI;
+// the shared-memory build (make local, -DNO_MPI) has a single rank and gets its parallelism from
+// the thread pool, so every operation there is a copy or a no-op and no MPI runtime is started.
+#ifdef NO_MPI
+typedef int Comm;
+#define COMM_WORLD 0
+#define COMM_SELF 0
+#else
+#include <mpi.h>
+typedef MPI_Comm Comm;
+#define COMM_WORLD MPI_COMM_WORLD
+#define COMM_SELF MPI_COMM_SELF
+#endif // NO_MPI
+
+// receive from whichever rank sends first
+#define COMM_ANY_SOURCE -1
+
+void comm_init(int *argc, char ***argv);
+void comm_finalize();
+int comm_rank(Comm comm);
+int comm_size(Comm comm);
+void comm_barrier(Comm comm);
+
+// wall-clock seconds
+double comm_time();
+
+// copy bytes from rank 0 to every rank of comm
+void broadcast_bytes(void *data, size_t bytes, Comm comm);
+
+template <typename T>
+void broadcast_value(T &value, Comm comm)
+{
+    broadcast_bytes(&value, sizeof(T), comm);
+}
+
+// broadcast a string, resizing it on the receiving ranks
+void broadcast_string(std::string &text, Comm comm);
+
+// collect size bytes from every rank, in rank order, into gathered on rank 0
+void gather_bytes(const char *data, int size, std::vector<char> &gathered, Comm comm);
+
+// collect count values from every rank, in rank order, into gathered on root
+void gather_u64(const uint64_t *values, int count, std::vector<uint64_t> &gathered, int root, Comm comm);
+
+// sum of value over all ranks, and over the ranks before this one (0 on rank 0)
+long long allreduce_sum(long long value, Comm comm);
+long long exclusive_scan_sum(long long value, Comm comm);
+
+// element-wise sum of count values over all ranks, into sums on every rank
+void allreduce_sum(const long long *values, long long *sums, int count, Comm comm);
+
+// element-wise min, max and sum of count doubles over all ranks, valid on rank 0
+void reduce_min_max_sum(const double *values, double *min, double *max, double *sum, int count, Comm comm);
+
+// point to point messages; recv_bytes returns the rank the message came from
+void send_bytes(const void *data, size_t bytes, int dest, int tag, Comm comm);
+int recv_bytes(void *data, size_t bytes, int source, int tag, Comm comm);
+
+// A file that every rank of a communicator writes at its own offsets: MPI-IO in the MPI build,
+// pwrite in the shared-memory build. Opening and closing are collective over comm.
+class ParallelFile
+{
+public:
+    ParallelFile(const std::string &filepath, Comm comm);
+    ~ParallelFile();
+
+    ParallelFile(const ParallelFile &) = delete;
+    ParallelFile &operator=(const ParallelFile &) = delete;
+
+    // truncate or extend the file; collective
+    void set_size(long long bytes);
+
+    // write at offset from this rank alone
+    void write_at(long long offset, const void *data, size_t bytes);
+
+    // Start writing at offset from this rank alone and return at once, so the write proceeds while the
+    // rank goes on working. data must stay valid until close.
+    void iwrite_at(long long offset, const void *data, size_t bytes);
+
+    // waits for every write started with iwrite_at; collective
+    void close();
+
+private:
+    Comm comm;
+#ifdef NO_MPI
+    int fd = -1;
+#else
+    MPI_File fh = MPI_FILE_NULL;
+    std::vector<MPI_Request> pending;
+#endif // NO_MPI
+};
+
+// An image that only rank 0 holds, placed once per node in memory that every rank of the node maps, so
+// ranks read their rows in place instead of each receiving a copy. In the MPI build the ranks of comm are
+// grouped by node with MPI_Comm_split_type; rank 0 copies the image into its node's MPI_Win_allocate_shared
+// window and the leaders of the other nodes receive it with one broadcast among the leaders, so only they
+// talk across nodes. Rank 0 of a single-rank comm, and the one rank of the shared-memory build, read the
+// image itself. Creating and closing are collective over comm.
+class RowWindow
+{
+public:
+    // rows, cols and type describe the image on every rank
+    RowWindow(const cv::Mat &image, int rows, int cols, int type, Comm comm);
+    ~RowWindow();
+
+    RowWindow(const RowWindow &) = delete;
+    RowWindow &operator=(const RowWindow &) = delete;
+
+    // a view of rows [first, end) of the image, valid until close
+    cv::Mat row_range(int first, int end) const;
+
+    void close();
+
+private:
+    Comm comm;
+    cv::Mat image;
+#ifndef NO_MPI
+    MPI_Comm node_comm = MPI_COMM_NULL;
+    MPI_Win win = MPI_WIN_NULL;
+#endif // NO_MPI
+};
+
+// A counter on rank 0 that every rank of comm atomically fetches and increments to claim the next
+// piece of work, so faster ranks simply claim more. Starts at 0. Creating and closing are collective.
+class WorkCounter
+{
+public:
+    explicit WorkCounter(Comm comm);
+    ~WorkCounter();
+
+    WorkCounter(const WorkCounter &) = delete;
+    WorkCounter &operator=(const WorkCounter &) = delete;
+
+    // the value before this rank's increment
+    long long next();
+
+    void close();
+
+private:
+    Comm comm;
+    long long value = 0;
+#ifndef NO_MPI
+    MPI_Win win = MPI_WIN_NULL;
+#endif // NO_MPI
+};
+
+#endif // __COMM_HPP__
@@ -0,0 +1,176 @@
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "comm.hpp"
+
+// A single rank: every collective is a copy between this rank's own buffers, or nothing at all
+
+void comm_init(int *, char ***)
+{
+}
+
+void comm_finalize()
+{
+}
+
+int comm_rank(Comm)
+{
+    return 0;
+}
+
+int comm_size(Comm)
+{
+    return 1;
+}
+
+void comm_barrier(Comm)
+{
+}
+
+double comm_time()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void broadcast_bytes(void *, size_t, Comm)
+{
+}
+
+void broadcast_string(std::string &, Comm)
+{
+}
+
+void gather_bytes(const char *data, int size, std::vector<char> &gathered, Comm)
+{
+    gathered.assign(data, data + size);
+}
+
+void gather_u64(const uint64_t *values, int count, std::vector<uint64_t> &gathered, int, Comm)
+{
+    gathered.assign(values, values + count);
+}
+
+long long allreduce_sum(long long value, Comm)
+{
+    return value;
+}
+
+long long exclusive_scan_sum(long long, Comm)
+{
+    return 0;
+}
+
+void allreduce_sum(const long long *values, long long *sums, int count, Comm)
+{
+    std::memcpy(sums, values, count * sizeof(long long));
+}
+
+void reduce_min_max_sum(const double *values, double *min, double *max, double *sum, int count, Comm)
+{
+    std::memcpy(min, values, count * sizeof(double));
+    std::memcpy(max, values, count * sizeof(double));
+    std::memcpy(sum, values, count * sizeof(double));
+}
+
+void send_bytes(const void *, size_t, int, int, Comm)
+{
+    throw std::logic_error("There are no other ranks to send to in the shared-memory build");
+}
+
+int recv_bytes(void *, size_t, int, int, Comm)
+{
+    throw std::logic_error("There are no other ranks to receive from in the shared-memory build");
+}
+
+ParallelFile::ParallelFile(const std::string &filepath, Comm comm) : comm(comm)
+{
+    fd = ::open(filepath.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not open " + filepath + " for writing");
+    }
+}
+
+ParallelFile::~ParallelFile()
+{
+    close();
+}
+
+void ParallelFile::set_size(long long bytes)
+{
+    if (ftruncate(fd, bytes) != 0)
+    {
+        throw std::runtime_error("Could not resize an output file");
+    }
+}
+
+void ParallelFile::write_at(long long offset, const void *data, size_t bytes)
+{
+    const char *pos = static_cast<const char *>(data);
+    while (bytes > 0)
+    {
+        ssize_t written = pwrite(fd, pos, bytes, offset);
+        if (written <= 0)
+        {
+            throw std::runtime_error("Could not write an output file");
+        }
+        pos += written;
+        offset += written;
+        bytes -= written;
+    }
+}
+
+// pwrite does not wait for the disk anyway
+void ParallelFile::iwrite_at(long long offset, const void *data, size_t bytes)
+{
+    write_at(offset, data, bytes);
+}
+
+void ParallelFile::close()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+RowWindow::RowWindow(const cv::Mat &image, int, int, int, Comm comm) : comm(comm), image(image)
+{
+}
+
+RowWindow::~RowWindow()
+{
+    close();
+}
+
+cv::Mat RowWindow::row_range(int first, int end) const
+{
+    return image.rowRange(first, end);
+}
+
+void RowWindow::close()
+{
+    image.release();
+}
+
+WorkCounter::WorkCounter(Comm comm) : comm(comm)
+{
+}
+
+WorkCounter::~WorkCounter()
+{
+    close();
+}
+
+long long WorkCounter::next()
+{
+    return value++;
+}
+
+void WorkCounter::close()
+{
+}
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+#include "comm.hpp"
+
+void comm_init(int *argc, char ***argv)
+{
+    MPI_Init(argc, argv);
+}
+
+void comm_finalize()
+{
+    MPI_Finalize();
+}
+
+int comm_rank(Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    return rank;
+}
+
+int comm_size(Comm comm)
+{
+    int size;
+    MPI_Comm_size(comm, &size);
+    return size;
+}
+
+void comm_barrier(Comm comm)
+{
+    MPI_Barrier(comm);
+}
+
+double comm_time()
+{
+    return MPI_Wtime();
+}
+
+void broadcast_bytes(void *data, size_t bytes, Comm comm)
+{
+    for (size_t pos = 0; pos < bytes; pos += INT_MAX)
+    {
+        int count = static_cast<int>(std::min(static_cast<size_t>(INT_MAX), bytes - pos));
+        MPI_Bcast(static_cast<char *>(data) + pos, count, MPI_BYTE, 0, comm);
+    }
+}
+
+void broadcast_string(std::string &text, Comm comm)
+{
+    unsigned long long length = text.size();
+    MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG_LONG, 0, comm);
+    text.resize(length);
+    broadcast_bytes(&text[0], length, comm);
+}
+
+void gather_bytes(const char *data, int size, std::vector<char> &gathered, Comm comm)
+{
+    int my_rank = comm_rank(comm);
+    int num_ranks = comm_size(comm);
+
+    // Gather sizes first to prepare the buffer on rank 0
+    std::vector<int> sizes(num_ranks, 0);
+    MPI_Gather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, comm);
+
+    std::vector<int> displacements(num_ranks, 0);
+    if (my_rank == 0)
+    {
+        int total_size = 0;
+        for (int i = 0; i < num_ranks; ++i)
+        {
+            displacements[i] = total_size;
+            total_size += sizes[i];
+        }
+        gathered.resize(total_size);
+    }
+
+    MPI_Gatherv(data, size, MPI_CHAR, gathered.data(), sizes.data(), displacements.data(), MPI_CHAR, 0, comm);
+}
+
+void gather_u64(const uint64_t *values, int count, std::vector<uint64_t> &gathered, int root, Comm comm)
+{
+    if (comm_rank(comm) == root)
+    {
+        gathered.resize(static_cast<size_t>(count) * comm_size(comm));
+    }
+    MPI_Gather(values, count, MPI_UINT64_T, gathered.data(), count, MPI_UINT64_T, root, comm);
+}
+
+long long allreduce_sum(long long value, Comm comm)
+{
+    long long sum = 0;
+    MPI_Allreduce(&value, &sum, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    return sum;
+}
+
+long long exclusive_scan_sum(long long value, Comm comm)
+{
+    long long sum = 0;
+    MPI_Exscan(&value, &sum, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    // the receive buffer of rank 0 is undefined after an Exscan
+    return comm_rank(comm) == 0 ? 0 : sum;
+}
+
+void allreduce_sum(const long long *values, long long *sums, int count, Comm comm)
+{
+    MPI_Allreduce(values, sums, count, MPI_LONG_LONG, MPI_SUM, comm);
+}
+
+void reduce_min_max_sum(const double *values, double *min, double *max, double *sum, int count, Comm comm)
+{
+    MPI_Reduce(values, min, count, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(values, max, count, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(values, sum, count, MPI_DOUBLE, MPI_SUM, 0, comm);
+}
+
+void send_bytes(const void *data, size_t bytes, int dest, int tag, Comm comm)
+{
+    if (bytes > INT_MAX)
+    {
+        throw std::runtime_error("Message too large to send");
+    }
+    MPI_Send(data, static_cast<int>(bytes), MPI_BYTE, dest, tag, comm);
+}
+
+int recv_bytes(void *data, size_t bytes, int source, int tag, Comm comm)
+{
+    if (bytes > INT_MAX)
+    {
+        throw std::runtime_error("Message too large to receive");
+    }
+    MPI_Status status;
+    MPI_Recv(data, static_cast<int>(bytes), MPI_BYTE, source == COMM_ANY_SOURCE ? MPI_ANY_SOURCE : source, tag, comm, &status);
+    return status.MPI_SOURCE;
+}
+
+ParallelFile::ParallelFile(const std::string &filepath, Comm comm) : comm(comm)
+{
+    MPI_File_open(comm, filepath.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+}
+
+ParallelFile::~ParallelFile()
+{
+    close();
+}
+
+void ParallelFile::set_size(long long bytes)
+{
+    MPI_File_set_size(fh, bytes);
+}
+
+// split into writes of at most INT_MAX bytes
+void ParallelFile::write_at(long long offset, const void *data, size_t bytes)
+{
+    MPI_Status status;
+    for (size_t pos = 0; pos < bytes; pos += INT_MAX)
+    {
+        int count = static_cast<int>(std::min(static_cast<size_t>(INT_MAX), bytes - pos));
+        MPI_File_write_at(fh, offset + pos, static_cast<const char *>(data) + pos, count, MPI_BYTE, &status);
+    }
+}
+
+// one request per INT_MAX bytes, all completed in close
+void ParallelFile::iwrite_at(long long offset, const void *data, size_t bytes)
+{
+    for (size_t pos = 0; pos < bytes; pos += INT_MAX)
+    {
+        int count = static_cast<int>(std::min(static_cast<size_t>(INT_MAX), bytes - pos));
+        pending.emplace_back();
+        MPI_File_iwrite_at(fh, offset + pos, static_cast<const char *>(data) + pos, count, MPI_BYTE, &pending.back());
+    }
+}
+
+void ParallelFile::close()
+{
+    if (fh != MPI_FILE_NULL)
+    {
+        MPI_Waitall(static_cast<int>(pending.size()), pending.data(), MPI_STATUSES_IGNORE);
+        pending.clear();
+        MPI_File_close(&fh);
+    }
+}
+
+// Every node leader allocates the whole image in its node's shared window and the other ranks of the node
+// map the leader's segment. The ranks are split with their rank in comm as the key, so rank 0 leads its node.
+RowWindow::RowWindow(const cv::Mat &image, int rows, int cols, int type, Comm comm) : comm(comm)
+{
+    if (comm_size(comm) == 1)
+    {
+        this->image = image;
+        return;
+    }
+
+    int my_rank = comm_rank(comm);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, &node_comm);
+    bool leader = comm_rank(node_comm) == 0;
+
+    MPI_Aint bytes = static_cast<MPI_Aint>(rows) * cols * CV_ELEM_SIZE(type);
+    void *base = nullptr;
+    MPI_Win_allocate_shared(leader ? bytes : 0, 1, MPI_INFO_NULL, node_comm, &base, &win);
+    if (!leader)
+    {
+        MPI_Aint size;
+        int disp_unit;
+        MPI_Win_shared_query(win, 0, &size, &disp_unit, &base);
+    }
+    this->image = cv::Mat(rows, cols, type, base);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+
+    MPI_Comm leaders;
+    MPI_Comm_split(comm, leader ? 0 : MPI_UNDEFINED, my_rank, &leaders);
+    if (leaders != MPI_COMM_NULL)
+    {
+        if (my_rank == 0)
+        {
+            image.copyTo(this->image);
+        }
+        broadcast_bytes(this->image.data, bytes, leaders);
+        MPI_Comm_free(&leaders);
+    }
+
+    // the leader has filled the window before any rank of its node reads it
+    MPI_Win_sync(win);
+    MPI_Barrier(node_comm);
+    MPI_Win_sync(win);
+}
+
+RowWindow::~RowWindow()
+{
+    close();
+}
+
+cv::Mat RowWindow::row_range(int first, int end) const
+{
+    return image.rowRange(first, end);
+}
+
+// rows of a shared window must not be read once the leader may have freed it
+void RowWindow::close()
+{
+    image.release();
+    if (win != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(win);
+        MPI_Win_free(&win);
+        MPI_Comm_free(&node_comm);
+    }
+}
+
+// value is set before the window is created, so no rank can fetch it before it is initialized.
+// A single rank counts on its own.
+WorkCounter::WorkCounter(Comm comm) : comm(comm)
+{
+    bool root = comm_rank(comm) == 0;
+    if (comm_size(comm) > 1)
+    {
+        MPI_Win_create(root ? &value : nullptr, root ? sizeof(value) : 0, sizeof(value), MPI_INFO_NULL, comm, &win);
+        MPI_Win_lock_all(0, win);
+    }
+}
+
+WorkCounter::~WorkCounter()
+{
+    close();
+}
+
+long long WorkCounter::next()
+{
+    if (win == MPI_WIN_NULL)
+    {
+        return value++;
+    }
+
+    long long one = 1;
+    long long previous = 0;
+    MPI_Fetch_and_op(&one, &previous, MPI_LONG_LONG, 0, 0, MPI_SUM, win);
+    MPI_Win_flush(0, win);
+    return previous;
+}
+
+void WorkCounter::close()
+{
+    if (win != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(win);
+        MPI_Win_free(&win);
+    }
+}
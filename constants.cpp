@@ -2,8 +2,21 @@
 
 namespace constants
 {
-    int CHARACTER_WIDTH = 10;
-    int CHARACTER_HEIGHT = 18;
-    float SCALE_FACTOR = 1.0;
-    std::string CHARACTERS = " .'`^\",:;Il!i><~+_-?][}{1)(|\\//tfjrxnuvczXYUJCLQ0OZmwqpbdkhao*#MWM&8%B@$";
+    const int CHARACTER_WIDTH = 10;
+    const int CHARACTER_HEIGHT = 18;
+    // -f and -s start from these; every conversion reads its own copy from its ConverterConfig
+    const float DEFAULT_SCALE_FACTOR = 1.0;
+    const std::string DEFAULT_CHARACTERS = " .'`^\",:;Il!i><~+_-?][}{1)(|\\//tfjrxnuvczXYUJCLQ0OZmwqpbdkhao*#MWM&8%B@$";
+    // in batch mode, images with more cells than this are split across all ranks instead of converted by one
+    const int BATCH_SPLIT_CELLS = 1 << 18;
+    // with --stream, source rows decoded at a time (more if a single cell row covers more)
+    const int STREAM_BAND_ROWS = 256;
+    // an image split across ranks is cut into this many chunks of cell rows per rank, claimed one at a time
+    const int CHUNKS_PER_RANK = 8;
+    // with --cache, the size the cache directory is evicted down to unless --cache-size says otherwise
+    const long long RESULT_CACHE_BYTES = 1LL << 30;
+    // deflate level of the PNG unless --png-level says otherwise, the fastest that still compresses
+    const int PNG_COMPRESSION_LEVEL = 1;
+    // largest rendered image Converter::convert allocates, so a tiny but very tall image cannot ask for many GB
+    const long long MAX_RENDER_BYTES = 1LL << 32;
 }
@@ -5,10 +5,16 @@
 
 namespace constants
 {
-    extern int CHARACTER_WIDTH;
-    extern int CHARACTER_HEIGHT;
-    extern float SCALE_FACTOR;
-    extern std::string CHARACTERS;
+    extern const int CHARACTER_WIDTH;
+    extern const int CHARACTER_HEIGHT;
+    extern const float DEFAULT_SCALE_FACTOR;
+    extern const std::string DEFAULT_CHARACTERS;
+    extern const int BATCH_SPLIT_CELLS;
+    extern const int STREAM_BAND_ROWS;
+    extern const int CHUNKS_PER_RANK;
+    extern const long long RESULT_CACHE_BYTES;
+    extern const int PNG_COMPRESSION_LEVEL;
+    extern const long long MAX_RENDER_BYTES;
 }
 
 #endif // __CONSTANTS_HPP__
@@ -0,0 +1,114 @@
+#include <stdexcept>
+
+#include "converter.hpp"
+#include "image_processing.hpp"
+#include "downsample.hpp"
+#include "utils.hpp"
+#include "profiler.hpp"
+
+// check the config before any table is built from it
+static const ConverterConfig &validate_config(const ConverterConfig &config)
+{
+    // written so that NaN fails too
+    if (!(config.scale_factor >= 0.1f && config.scale_factor <= 1.0f))
+    {
+        throw std::invalid_argument("The scale factor must be between 0.1 and 1.0");
+    }
+    // glyph indices are stored in a single byte
+    if (config.characters.empty() || config.characters.size() > 256)
+    {
+        throw std::invalid_argument("The character set must contain between 1 and 256 characters");
+    }
+    if (config.cell_width <= 0 || config.cell_height <= 0)
+    {
+        throw std::invalid_argument("The character cell must be at least one pixel wide and high");
+    }
+    return config;
+}
+
+// the charset in the order glyph indices map to, reversed for a negative
+static std::string glyph_order(const ConverterConfig &config)
+{
+    std::string characters = config.characters;
+    if (config.negate_flag)
+    {
+        reverse_string(characters);
+    }
+    return characters;
+}
+
+Converter::Converter(const ConverterConfig &config)
+    : settings(validate_config(config)),
+      glyphs(build_glyph_atlas(glyph_order(settings), settings.cell_width, settings.cell_height)),
+      luminance(build_luminance_lut(settings.characters.size(), settings.rec601_flag)),
+      glyph_shapes(build_glyph_shapes(glyphs, settings.negate_flag)),
+      glyph_renderer(select_glyph_renderer(glyphs, settings.colored_flag))
+{
+}
+
+cv::Size Converter::grid_size(int desired_width, int desired_height) const
+{
+    return get_grid_size(desired_width, desired_height, settings.scale_factor, settings.cell_width, settings.cell_height);
+}
+
+std::pair<std::string, cv::Mat> Converter::convert(const cv::Mat &image, int desired_width) const
+{
+    // a pool of one runs every band on the calling thread
+    ThreadPool pool(1);
+    return convert(image, desired_width, pool);
+}
+
+// Same sizing as the command line: the height follows the aspect ratio of the image, and with
+// area_flag the source is averaged into cells unless the grid is empty or larger than it. Throws
+// std::invalid_argument rather than allocate a rendered image over constants::MAX_RENDER_BYTES.
+std::pair<std::string, cv::Mat> Converter::convert(const cv::Mat &image, int desired_width, ThreadPool &pool) const
+{
+    if (image.empty() || image.type() != CV_8UC3)
+    {
+        throw std::invalid_argument("Only non-empty 8-bit BGR images can be converted");
+    }
+
+    int width = (desired_width > 0) ? desired_width : image.cols;
+    long long height = (desired_width > 0) ? static_cast<long long>(image.rows) * width / image.cols : image.rows;
+    const long long cell_bytes = 3LL * settings.cell_width * settings.cell_height;
+    if (height > constants::MAX_RENDER_BYTES / cell_bytes)
+    {
+        throw std::invalid_argument("The ASCII image would be too large");
+    }
+    cv::Size grid = grid_size(width, static_cast<int>(height));
+    if (static_cast<long long>(grid.width) * grid.height > constants::MAX_RENDER_BYTES / cell_bytes)
+    {
+        throw std::invalid_argument("The ASCII image would be too large");
+    }
+
+    if (settings.area_flag && grid.width > 0 && grid.height > 0 && grid.width <= image.cols && grid.height <= image.rows)
+    {
+        std::pair<std::string, cv::Mat> output;
+        output.first.assign(static_cast<size_t>(grid.height) * (grid.width + 1), '\n');
+        output.second.create(settings.cell_height * grid.height, settings.cell_width * grid.width, CV_8UC3);
+        profile_count_allocation(output.first.size());
+        profile_count_allocation(output.second.total() * output.second.elemSize());
+
+        convert_area(image, image.rows, 0, grid.height, grid, pool, &output.first[0], output.second);
+        return output;
+    }
+
+    // resize_image replaces the pixels of resized, never those of image
+    cv::Mat resized = image;
+    resize_image(resized, grid);
+    return convert_rows(resized, pool);
+}
+
+std::pair<std::string, cv::Mat> Converter::convert_rows(const cv::Mat &image, ThreadPool &pool) const
+{
+#ifdef USE_GPU
+    return process_image(image, luminance, glyphs, glyph_renderer, settings.threads_x, settings.threads_y);
+#else
+    return process_image(image, luminance, glyphs, glyph_renderer, pool);
+#endif // USE_GPU
+}
+
+void Converter::convert_area(const cv::Mat &source, int source_total_rows, int first_cell_row, int end_cell_row, cv::Size grid, ThreadPool &pool, char *ascii_art, cv::Mat &ascii_image, cv::Mat *cell_colors) const
+{
+    process_image_area(source, source_total_rows, first_cell_row, end_cell_row, grid, luminance, glyphs, settings.shape_flag ? &glyph_shapes : nullptr, glyph_renderer, pool, ascii_art, ascii_image, cell_colors);
+}
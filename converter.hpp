@@ -0,0 +1,77 @@
+#ifndef __CONVERTER_HPP__
+#define __CONVERTER_HPP__
+
+#include <string>
+#include <utility>
+#include <opencv2/opencv.hpp>
+
+#include "constants.hpp"
+#include "glyph_atlas.hpp"
+#include "glyph_shapes.hpp"
+#include "luminance.hpp"
+#include "thread_pool.hpp"
+
+// Settings of one Converter, fixed when it is constructed
+struct ConverterConfig
+{
+    // from darkest to brightest cell; negate_flag reverses them
+    std::string characters = constants::DEFAULT_CHARACTERS;
+    // from 0.1 to 1.0, shrinks the character grid
+    float scale_factor = constants::DEFAULT_SCALE_FACTOR;
+    bool negate_flag = false;
+    bool colored_flag = false;
+    bool rec601_flag = false;
+    // average each cell's block of source pixels instead of resizing the image first
+    bool area_flag = false;
+    // pick every glyph by the shape of its cell's block rather than by its brightness alone; needs the source
+    // pixels under every cell, so it only applies with area_flag, and only where the grid is smaller than the image
+    bool shape_flag = false;
+    int cell_width = constants::CHARACTER_WIDTH;
+    int cell_height = constants::CHARACTER_HEIGHT;
+#ifdef USE_GPU
+    // CUDA block of the conversion kernel; the host threads of a pool only run the area downsample
+    int threads_x = 16;
+    int threads_y = 16;
+#endif // USE_GPU
+};
+
+// Converts images to ASCII art with one configuration. The glyph atlas and luminance table are built, and the
+// rendering kernel for the color mode and cell size is picked, once in the constructor; none of them changes
+// afterwards, so a single Converter can be shared by any number of threads converting images at the same time.
+// Each concurrent call needs its own ThreadPool (or none), since a pool runs one parallel_for at a time.
+class Converter
+{
+public:
+    // throws std::invalid_argument if the config is out of range
+    explicit Converter(const ConverterConfig &config);
+
+    const ConverterConfig &config() const { return settings; }
+    const LuminanceLut &lut() const { return luminance; }
+    const GlyphAtlas &atlas() const { return glyphs; }
+    const GlyphShapes &shapes() const { return glyph_shapes; }
+    const GlyphRenderer &renderer() const { return glyph_renderer; }
+
+    // size of the character grid for an image resized to desired_width x desired_height
+    cv::Size grid_size(int desired_width, int desired_height) const;
+
+    // Convert a whole image desired_width characters wide (0 keeps the image width) into the text and
+    // the rendered image, on the calling thread or split across pool.
+    std::pair<std::string, cv::Mat> convert(const cv::Mat &image, int desired_width) const;
+    std::pair<std::string, cv::Mat> convert(const cv::Mat &image, int desired_width, ThreadPool &pool) const;
+
+    // Convert an image that is already the size of the grid, one cell per pixel
+    std::pair<std::string, cv::Mat> convert_rows(const cv::Mat &image, ThreadPool &pool) const;
+
+    // Convert cell rows [first_cell_row, end_cell_row) of grid straight from the source rows under them,
+    // writing in place as process_image_area does, along with the color of every cell if cell_colors is set
+    void convert_area(const cv::Mat &source, int source_total_rows, int first_cell_row, int end_cell_row, cv::Size grid, ThreadPool &pool, char *ascii_art, cv::Mat &ascii_image, cv::Mat *cell_colors = nullptr) const;
+
+private:
+    const ConverterConfig settings;
+    const GlyphAtlas glyphs;
+    const LuminanceLut luminance;
+    const GlyphShapes glyph_shapes;
+    const GlyphRenderer glyph_renderer;
+};
+
+#endif // __CONVERTER_HPP__
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "daemon.hpp"
+#include "daemon_protocol.hpp"
+#include "bounded_queue.hpp"
+#include "image_processing.hpp"
+#include "raster_writer.hpp"
+
+// distinct option sets whose converters stay warm
+static const size_t MAX_CACHED_CONVERTERS = 16;
+// latest jobs the percentiles are taken over
+static const size_t LATENCY_WINDOW = 1 << 16;
+// accepted connections waiting for a free worker
+static const size_t CONNECTION_QUEUE_DEPTH = 1024;
+
+// set by SIGINT, SIGTERM or a JOB_SHUTDOWN; the accept loop checks it every POLL_INTERVAL_MS
+static std::atomic<bool> stop_requested(false);
+static const int POLL_INTERVAL_MS = 200;
+
+static void request_stop(int)
+{
+    stop_requested = true;
+}
+
+// Converters by their options, most recently used first. A converter is built outside the lock,
+// so a new option set never stalls the jobs of the others.
+class ConverterCache
+{
+public:
+    std::shared_ptr<const Converter> get(const ConverterConfig &config)
+    {
+        std::string key = config_key(config);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto entry = entries.begin(); entry != entries.end(); ++entry)
+            {
+                if (entry->first == key)
+                {
+                    entries.splice(entries.begin(), entries, entry);
+                    return entries.front().second;
+                }
+            }
+        }
+
+        std::shared_ptr<const Converter> converter = std::make_shared<const Converter>(config);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.emplace_front(key, converter);
+        if (entries.size() > MAX_CACHED_CONVERTERS)
+        {
+            entries.pop_back();
+        }
+        return converter;
+    }
+
+private:
+    // the charset is length-prefixed, so no two option sets share a key
+    static std::string config_key(const ConverterConfig &config)
+    {
+        std::ostringstream key;
+        key.precision(std::numeric_limits<float>::max_digits10);
+        key << config.characters.size() << ':' << config.characters << ' ' << config.scale_factor << ' '
+            << config.negate_flag << config.colored_flag << config.rec601_flag << config.area_flag << config.shape_flag;
+        return key.str();
+    }
+
+    std::mutex mutex;
+    std::list<std::pair<std::string, std::shared_ptr<const Converter>>> entries;
+};
+
+// Latency of the latest LATENCY_WINDOW jobs, from the whole job arriving to its reply being sent
+class LatencyRecorder
+{
+public:
+    void record(double seconds)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (window.size() < LATENCY_WINDOW)
+        {
+            window.push_back(seconds);
+        }
+        else
+        {
+            window[jobs % LATENCY_WINDOW] = seconds;
+        }
+        ++jobs;
+    }
+
+    std::string summary()
+    {
+        std::vector<double> sorted;
+        long long total;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sorted = window;
+            total = jobs;
+        }
+
+        std::ostringstream text;
+        text << "jobs " << total;
+        if (!sorted.empty())
+        {
+            std::sort(sorted.begin(), sorted.end());
+            auto percentile = [&](double fraction)
+            {
+                return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))] * 1e3;
+            };
+            text << ", p50 " << percentile(0.50) << " ms, p99 " << percentile(0.99) << " ms, max " << sorted.back() * 1e3 << " ms";
+        }
+        text << "\n";
+        return text.str();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<double> window;
+    long long jobs = 0;
+};
+
+// convert one job with the cached converter for its options; failures are reported in the reply
+static DaemonReply convert_job(const DaemonJob &job, const ConverterConfig &warm_config, ConverterCache &cache)
+{
+    DaemonReply reply;
+    try
+    {
+        ConverterConfig config = warm_config;
+        config.characters = job.characters.empty() ? constants::DEFAULT_CHARACTERS : job.characters;
+        config.scale_factor = job.scale_factor;
+        config.negate_flag = job.flags & JOB_NEGATE;
+        config.colored_flag = job.flags & JOB_COLOR;
+        config.rec601_flag = job.flags & JOB_REC601;
+        config.area_flag = job.flags & (JOB_AREA | JOB_SHAPE);
+        config.shape_flag = job.flags & JOB_SHAPE;
+        std::shared_ptr<const Converter> converter = cache.get(config);
+
+        cv::Mat image = job.image_bytes.empty() ? load_image(job.path) : cv::imdecode(job.image_bytes, cv::IMREAD_COLOR);
+        if (image.empty())
+        {
+            throw std::runtime_error("Could not decode the image bytes");
+        }
+
+        std::pair<std::string, cv::Mat> output = converter->convert(image, job.width);
+        if (job.flags & JOB_WANT_TEXT)
+        {
+            reply.text = std::move(output.first);
+        }
+        if (job.flags & JOB_WANT_PNG)
+        {
+            // the same fast PNG as the command line writes, on this worker's thread
+            ThreadPool pool(1);
+            reply.png = encode_raster(output.second, RasterOptions(), pool);
+        }
+        reply.ok = true;
+    }
+    catch (const std::exception &e)
+    {
+        reply.text = e.what();
+    }
+    return reply;
+}
+
+void run_daemon(const std::string &socket_path, const ConverterConfig &warm_config, int num_workers)
+{
+    sockaddr_un address;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path too long: " + socket_path);
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    // a socket left behind by a daemon that was killed is replaced, anything else is not
+    struct stat info;
+    if (lstat(socket_path.c_str(), &info) == 0)
+    {
+        if (!S_ISSOCK(info.st_mode))
+        {
+            throw std::runtime_error("Not a socket, refusing to replace it: " + socket_path);
+        }
+        unlink(socket_path.c_str());
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0)
+    {
+        throw std::runtime_error("Could not listen on " + socket_path + ": " + std::strerror(errno));
+    }
+
+    // no SA_RESTART, so the poll in the accept loop returns as soon as a signal arrives
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    stop_requested = false;
+
+    ConverterCache cache;
+    cache.get(warm_config);
+    LatencyRecorder latencies;
+
+    // connections being served, shut down on exit so workers blocked on an idle client return
+    std::mutex open_mutex;
+    std::set<int> open_connections;
+
+    BoundedQueue<int> connections(CONNECTION_QUEUE_DEPTH);
+    num_workers = std::max(1, num_workers);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < num_workers; ++i)
+    {
+        workers.emplace_back([&]
+                             {
+            int fd;
+            while (connections.pop(fd))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(open_mutex);
+                    if (stop_requested)
+                    {
+                        close(fd);
+                        continue;
+                    }
+                    open_connections.insert(fd);
+                }
+
+                DaemonJob job;
+                while (recv_job(fd, job))
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    DaemonReply reply;
+                    if (job.flags & JOB_STATS)
+                    {
+                        reply.ok = true;
+                        reply.text = latencies.summary();
+                    }
+                    else if (job.flags & JOB_SHUTDOWN)
+                    {
+                        reply.ok = true;
+                    }
+                    else
+                    {
+                        reply = convert_job(job, warm_config, cache);
+                    }
+
+                    if (!send_reply(fd, reply))
+                    {
+                        break;
+                    }
+                    // only once the reply is out, since stopping shuts every open connection down
+                    if (job.flags & JOB_SHUTDOWN)
+                    {
+                        stop_requested = true;
+                    }
+                    else if (!(job.flags & JOB_STATS))
+                    {
+                        latencies.record(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(open_mutex);
+                    open_connections.erase(fd);
+                }
+                close(fd);
+            } });
+    }
+
+    std::cout << "Listening on " << socket_path << " with " << num_workers << " worker threads\n";
+    std::cout.flush();
+
+    while (!stop_requested)
+    {
+        pollfd ready = {listen_fd, POLLIN, 0};
+        if (poll(&ready, 1, POLL_INTERVAL_MS) <= 0)
+        {
+            continue;
+        }
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0)
+        {
+            connections.push(fd);
+        }
+    }
+
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    connections.close();
+    {
+        std::lock_guard<std::mutex> lock(open_mutex);
+        for (int fd : open_connections)
+        {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    std::cout << "Daemon stopped: " << latencies.summary();
+}
@@ -0,0 +1,15 @@
+#ifndef __DAEMON_HPP__
+#define __DAEMON_HPP__
+
+#include <string>
+
+#include "converter.hpp"
+
+// Serve conversion jobs (see daemon_protocol.hpp) on a Unix domain socket at socket_path until a client
+// sends JOB_SHUTDOWN or the process gets SIGINT or SIGTERM. num_workers threads each serve one connection
+// at a time, so concurrent clients are converted in parallel. The Converter for every distinct set of
+// options is built on first use and kept warm for later jobs, starting with warm_config, which also
+// supplies the cell size (and CUDA block) of every job. Prints the latency percentiles on exit.
+void run_daemon(const std::string &socket_path, const ConverterConfig &warm_config, int num_workers);
+
+#endif // __DAEMON_HPP__
@@ -0,0 +1,157 @@
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon_protocol.hpp"
+
+static const uint32_t JOB_MAGIC = 0x4a324141;   // "AA2J"
+static const uint32_t REPLY_MAGIC = 0x52324141; // "AA2R"
+
+// largest fields either side accepts, so a corrupt header cannot make the other end allocate gigabytes
+static const uint32_t MAX_PATH_BYTES = 4096;
+static const uint32_t MAX_CHARSET_BYTES = 256;
+static const uint64_t MAX_PAYLOAD_BYTES = 1ULL << 30;
+// widest grid a job may ask for, in characters; the rendered image is 10 pixels per character wide
+static const int32_t MAX_JOB_WIDTH = 16384;
+
+struct JobHeader
+{
+    uint32_t magic;
+    uint32_t flags;
+    int32_t width;
+    float scale_factor;
+    uint32_t charset_bytes;
+    uint32_t path_bytes;
+    uint64_t image_bytes;
+};
+
+struct ReplyHeader
+{
+    uint32_t magic;
+    uint32_t ok;
+    uint64_t text_bytes;
+    uint64_t png_bytes;
+};
+
+static bool send_all(int fd, const void *data, size_t bytes)
+{
+    const char *pos = static_cast<const char *>(data);
+    while (bytes > 0)
+    {
+        // a client that hung up must not kill the daemon with SIGPIPE
+        ssize_t sent = send(fd, pos, bytes, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return false;
+        }
+        pos += sent;
+        bytes -= sent;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void *data, size_t bytes)
+{
+    char *pos = static_cast<char *>(data);
+    while (bytes > 0)
+    {
+        ssize_t received = recv(fd, pos, bytes, 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            return false;
+        }
+        pos += received;
+        bytes -= received;
+    }
+    return true;
+}
+
+bool send_job(int fd, const DaemonJob &job)
+{
+    JobHeader header = {JOB_MAGIC, job.flags, job.width, job.scale_factor,
+                        static_cast<uint32_t>(job.characters.size()), static_cast<uint32_t>(job.path.size()), job.image_bytes.size()};
+    return send_all(fd, &header, sizeof(header)) &&
+           send_all(fd, job.characters.data(), job.characters.size()) &&
+           send_all(fd, job.path.data(), job.path.size()) &&
+           send_all(fd, job.image_bytes.data(), job.image_bytes.size());
+}
+
+bool recv_job(int fd, DaemonJob &job)
+{
+    JobHeader header;
+    if (!recv_all(fd, &header, sizeof(header)) || header.magic != JOB_MAGIC ||
+        header.charset_bytes > MAX_CHARSET_BYTES || header.path_bytes > MAX_PATH_BYTES || header.image_bytes > MAX_PAYLOAD_BYTES ||
+        header.width < 0 || header.width > MAX_JOB_WIDTH || !std::isfinite(header.scale_factor))
+    {
+        return false;
+    }
+
+    job.flags = header.flags;
+    job.width = header.width;
+    job.scale_factor = header.scale_factor;
+    job.characters.resize(header.charset_bytes);
+    job.path.resize(header.path_bytes);
+    job.image_bytes.resize(header.image_bytes);
+    return recv_all(fd, &job.characters[0], job.characters.size()) &&
+           recv_all(fd, &job.path[0], job.path.size()) &&
+           recv_all(fd, job.image_bytes.data(), job.image_bytes.size());
+}
+
+bool send_reply(int fd, const DaemonReply &reply)
+{
+    ReplyHeader header = {REPLY_MAGIC, reply.ok, reply.text.size(), reply.png.size()};
+    return send_all(fd, &header, sizeof(header)) &&
+           send_all(fd, reply.text.data(), reply.text.size()) &&
+           send_all(fd, reply.png.data(), reply.png.size());
+}
+
+bool recv_reply(int fd, DaemonReply &reply)
+{
+    ReplyHeader header;
+    if (!recv_all(fd, &header, sizeof(header)) || header.magic != REPLY_MAGIC ||
+        header.text_bytes > MAX_PAYLOAD_BYTES || header.png_bytes > MAX_PAYLOAD_BYTES)
+    {
+        return false;
+    }
+
+    reply.ok = header.ok != 0;
+    reply.text.resize(header.text_bytes);
+    reply.png.resize(header.png_bytes);
+    return recv_all(fd, &reply.text[0], reply.text.size()) &&
+           recv_all(fd, reply.png.data(), reply.png.size());
+}
+
+int connect_daemon(const std::string &socket_path)
+{
+    sockaddr_un address;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
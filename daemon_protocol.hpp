@@ -0,0 +1,59 @@
+#ifndef __DAEMON_PROTOCOL_HPP__
+#define __DAEMON_PROTOCOL_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wire format between the conversion daemon (--listen) and its clients over a Unix domain socket.
+// Every message is a fixed header followed by the variable-length fields it announces, in host byte
+// order since both ends run on the same machine. A connection carries any number of jobs, each
+// answered by one reply before the next job is read.
+
+// what a job asks for
+enum JobFlag
+{
+    JOB_COLOR = 1 << 0,
+    JOB_NEGATE = 1 << 1,
+    JOB_REC601 = 1 << 2,
+    JOB_AREA = 1 << 3,
+    JOB_WANT_TEXT = 1 << 4,
+    JOB_WANT_PNG = 1 << 5,
+    // no conversion: reply with the daemon's latency percentiles as text
+    JOB_STATS = 1 << 6,
+    // no conversion: reply, then stop accepting connections and exit
+    JOB_SHUTDOWN = 1 << 7,
+    // match glyphs by shape; implies JOB_AREA
+    JOB_SHAPE = 1 << 8
+};
+
+// One conversion request. The image is read from path by the daemon unless image_bytes holds an
+// encoded image; an empty characters keeps the default charset and width 0 keeps the image width.
+struct DaemonJob
+{
+    uint32_t flags = JOB_WANT_TEXT;
+    int width = 0;
+    float scale_factor = 1.0f;
+    std::string characters;
+    std::string path;
+    std::vector<unsigned char> image_bytes;
+};
+
+// The answer to one job: the text and/or the PNG it asked for, or the reason it failed in text
+struct DaemonReply
+{
+    bool ok = false;
+    std::string text;
+    std::vector<unsigned char> png;
+};
+
+// Each returns false if the connection closed or sent something malformed
+bool send_job(int fd, const DaemonJob &job);
+bool recv_job(int fd, DaemonJob &job);
+bool send_reply(int fd, const DaemonReply &reply);
+bool recv_reply(int fd, DaemonReply &reply);
+
+// connect to the daemon listening on socket_path; returns -1 on failure
+int connect_daemon(const std::string &socket_path);
+
+#endif // __DAEMON_PROTOCOL_HPP__
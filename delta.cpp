@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cstring>
+
+#include "delta.hpp"
+
+static const uint16_t NO_COLOR = 0xFFFF;
+static const uint8_t NO_GLYPH = 0xFF;
+
+DeltaFormat parse_delta_format(const std::string &name)
+{
+    if (name == "ansi")
+    {
+        return DELTA_ANSI;
+    }
+    if (name == "bin" || name == "binary")
+    {
+        return DELTA_BINARY;
+    }
+    return DELTA_NONE;
+}
+
+// 5 bits per channel, so sensor noise does not count as a change
+static inline uint16_t quantize_color(const cv::Vec3b &bgr)
+{
+    return static_cast<uint16_t>(((bgr[2] >> 3) << 10) | ((bgr[1] >> 3) << 5) | (bgr[0] >> 3));
+}
+
+static inline cv::Vec3b dequantize_color(uint16_t color)
+{
+    uchar r = (color >> 10) & 31, g = (color >> 5) & 31, b = color & 31;
+    return cv::Vec3b((b << 3) | (b >> 2), (g << 3) | (g >> 2), (r << 3) | (r >> 2));
+}
+
+static void append_le32(std::string &out, uint32_t value)
+{
+    char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8), static_cast<char>(value >> 16), static_cast<char>(value >> 24)};
+    out.append(bytes, 4);
+}
+
+DeltaEncoder::DeltaEncoder(const LuminanceLut &lut, const GlyphAtlas &atlas, const std::string &characters, bool colored_flag, DeltaFormat format)
+    : lut(lut), atlas(atlas), characters(characters), colored_flag(colored_flag), format(format)
+{
+}
+
+// size the grids from the first frame; every cell of it counts as changed
+void DeltaEncoder::start(const cv::Mat &frame, std::string &out)
+{
+    rows = frame.rows;
+    cols = frame.cols;
+    glyphs.assign(static_cast<size_t>(rows) * cols, NO_GLYPH);
+    colors.assign(static_cast<size_t>(rows) * cols, NO_COLOR);
+    row_indices.resize(cols);
+    rendered = cv::Mat::zeros(rows * atlas.cell_height, cols * atlas.cell_width, CV_8UC3);
+
+    if (format == DELTA_ANSI)
+    {
+        out += "\x1b[2J";
+    }
+    else if (format == DELTA_BINARY)
+    {
+        out += "ADLT";
+        out += static_cast<char>(1);
+        out += static_cast<char>(colored_flag ? 1 : 0);
+        append_le32(out, cols);
+        append_le32(out, rows);
+    }
+}
+
+// write cells [start_col, end_col) of row, whose state has already been updated
+void DeltaEncoder::emit_run(int row, int start_col, int end_col, std::string &out)
+{
+    const size_t first = static_cast<size_t>(row) * cols;
+    ++runs_in_frame;
+
+    if (format == DELTA_ANSI)
+    {
+        out += "\x1b[" + std::to_string(row + 1) + ";" + std::to_string(start_col + 1) + "H";
+        for (int col = start_col; col < end_col; ++col)
+        {
+            if (colored_flag && colors[first + col] != ansi_color)
+            {
+                ansi_color = colors[first + col];
+                cv::Vec3b color = dequantize_color(colors[first + col]);
+                out += "\x1b[38;2;" + std::to_string(color[2]) + ";" + std::to_string(color[1]) + ";" + std::to_string(color[0]) + "m";
+            }
+            out += characters[glyphs[first + col]];
+        }
+    }
+    else if (format == DELTA_BINARY)
+    {
+        // runs longer than a u16 are split
+        for (int run_start = start_col; run_start < end_col; run_start += 0xFFFF)
+        {
+            int length = std::min(end_col - run_start, 0xFFFF);
+            if (run_start != start_col)
+            {
+                ++runs_in_frame;
+            }
+            append_le32(out, static_cast<uint32_t>(first + run_start));
+            out += static_cast<char>(length & 0xFF);
+            out += static_cast<char>(length >> 8);
+            out.append(reinterpret_cast<const char *>(&glyphs[first + run_start]), length);
+            if (colored_flag)
+            {
+                for (int col = run_start; col < run_start + length; ++col)
+                {
+                    cv::Vec3b color = dequantize_color(colors[first + col]);
+                    out += static_cast<char>(color[2]);
+                    out += static_cast<char>(color[1]);
+                    out += static_cast<char>(color[0]);
+                }
+            }
+        }
+    }
+}
+
+size_t DeltaEncoder::encode(const cv::Mat &frame, int frame_index, std::string &out)
+{
+    if (rendered.empty() || frame.rows != rows || frame.cols != cols)
+    {
+        start(frame, out);
+    }
+
+    size_t run_count_pos = 0;
+    if (format == DELTA_BINARY)
+    {
+        append_le32(out, frame_index);
+        run_count_pos = out.size();
+        append_le32(out, 0);
+    }
+    ansi_color = -1;
+    runs_in_frame = 0;
+
+    size_t changed = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        const cv::Vec3b *row = frame.ptr<cv::Vec3b>(i);
+        uint8_t *row_glyphs = &glyphs[static_cast<size_t>(i) * cols];
+        uint16_t *row_colors = &colors[static_cast<size_t>(i) * cols];
+
+        // finding the glyphs is a pass over the pixels; everything after it only touches changed cells
+        row_to_glyph_indices(row, cols, lut, row_indices.data());
+
+        int j = 0;
+        while (j < cols)
+        {
+            uint16_t color = colored_flag ? quantize_color(row[j]) : 0;
+            if (row_indices[j] == row_glyphs[j] && color == row_colors[j])
+            {
+                ++j;
+                continue;
+            }
+
+            // extend the run over every following changed cell
+            int run_start = j;
+            while (j < cols)
+            {
+                color = colored_flag ? quantize_color(row[j]) : 0;
+                if (row_indices[j] == row_glyphs[j] && color == row_colors[j])
+                {
+                    break;
+                }
+                row_glyphs[j] = row_indices[j];
+                row_colors[j] = color;
+                blit_glyph(rendered, i, j, atlas, row_indices[j], colored_flag, dequantize_color(color));
+                ++j;
+            }
+
+            changed += j - run_start;
+            emit_run(i, run_start, j, out);
+        }
+    }
+
+    if (format == DELTA_BINARY)
+    {
+        uint32_t runs = static_cast<uint32_t>(runs_in_frame);
+        char bytes[4] = {static_cast<char>(runs), static_cast<char>(runs >> 8), static_cast<char>(runs >> 16), static_cast<char>(runs >> 24)};
+        std::memcpy(&out[run_count_pos], bytes, 4);
+    }
+    else if (format == DELTA_ANSI)
+    {
+        // reset the color and park the cursor under the frame
+        out += "\x1b[0m\x1b[" + std::to_string(rows + 1) + ";1H";
+    }
+
+    return changed;
+}
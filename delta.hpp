@@ -0,0 +1,63 @@
+#ifndef __DELTA_HPP__
+#define __DELTA_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "glyph_atlas.hpp"
+#include "luminance.hpp"
+
+// How consecutive frames of a video are written when only their changes are kept
+enum DeltaFormat
+{
+    DELTA_NONE = 0,
+    DELTA_ANSI = 1,   // cursor-move escape sequences, playable with cat in a terminal
+    DELTA_BINARY = 2  // runs of changed cells, see DeltaEncoder::encode
+};
+
+// parse the argument of --delta; returns DELTA_NONE for anything unknown
+DeltaFormat parse_delta_format(const std::string &name);
+
+// Keeps the glyph and quantized color of every cell of the previous frame and only re-renders,
+// and emits, the cells that changed since.
+//
+// Binary stream layout (little endian):
+//   header: "ADLT", u8 version, u8 colored, u32 cols, u32 rows
+//   frame:  u32 frame index, u32 run count, then per run:
+//           u32 first cell (row * cols + col), u16 length, length glyph indices, length * 3 RGB bytes if colored
+class DeltaEncoder
+{
+public:
+    DeltaEncoder(const LuminanceLut &lut, const GlyphAtlas &atlas, const std::string &characters, bool colored_flag, DeltaFormat format);
+
+    // append the changes from the previous frame to out and update canvas(); returns the number of changed cells
+    size_t encode(const cv::Mat &frame, int frame_index, std::string &out);
+
+    // the rendered ASCII image of the last encoded frame, updated in place
+    const cv::Mat &canvas() const { return rendered; }
+
+private:
+    void start(const cv::Mat &frame, std::string &out);
+    void emit_run(int row, int start_col, int end_col, std::string &out);
+
+    const LuminanceLut &lut;
+    const GlyphAtlas &atlas;
+    const std::string characters;
+    const bool colored_flag;
+    const DeltaFormat format;
+
+    int rows = 0;
+    int cols = 0;
+    std::vector<uint8_t> glyphs;
+    std::vector<uint16_t> colors;
+    std::vector<uint8_t> row_indices;
+    cv::Mat rendered;
+
+    // last color escape written in the current ANSI frame
+    int ansi_color = -1;
+    size_t runs_in_frame = 0;
+};
+
+#endif // __DELTA_HPP__
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "downsample.hpp"
+#include "profiler.hpp"
+
+cv::Size get_grid_size(int desired_width, int desired_height, float scale_factor, int cell_width, int cell_height)
+{
+    return cv::Size(static_cast<int>(desired_width * scale_factor), static_cast<int>(desired_height * scale_factor * (static_cast<float>(cell_width) / cell_height)));
+}
+
+std::pair<int, int> get_source_row_range(int source_rows, int grid_rows, int first_cell_row, int end_cell_row)
+{
+    int start = static_cast<int>(static_cast<long long>(first_cell_row) * source_rows / grid_rows);
+    int end = static_cast<int>(static_cast<long long>(end_cell_row) * source_rows / grid_rows);
+    return {start, end};
+}
+
+// Average a row of cells' source blocks into their sub-blocks, then give every cell the mean of its block as
+// its color and the glyph whose shape is nearest to the gray levels of its sub-blocks. sub_sums is scratch.
+static void convert_row_shapes(const cv::Mat &source, int source_first_row, std::pair<int, int> block_rows, int grid_width, const std::vector<int> &sub_offset_of_column, const std::vector<int> &sub_width, const LuminanceLut &lut, const GlyphShapes &shapes, std::vector<uint32_t> &sub_sums, std::vector<cv::Vec3b> &colors, std::vector<uint8_t> &indices)
+{
+    const int block_height = block_rows.second - block_rows.first;
+    int sub_height[SHAPE_SIZE] = {0};
+    std::fill(sub_sums.begin(), sub_sums.end(), 0);
+
+    for (int y = block_rows.first; y < block_rows.second; ++y)
+    {
+        const int sub_row = (y - block_rows.first) * SHAPE_SIZE / block_height;
+        ++sub_height[sub_row];
+        uint32_t *row_sums = &sub_sums[3 * SHAPE_SIZE * sub_row];
+        const uchar *src = source.ptr<uchar>(y - source_first_row);
+        for (int x = 0; x < source.cols; ++x)
+        {
+            uint32_t *sum = row_sums + sub_offset_of_column[x];
+            sum[0] += src[3 * x];
+            sum[1] += src[3 * x + 1];
+            sum[2] += src[3 * x + 2];
+        }
+    }
+
+    uint8_t gray[SHAPE_FEATURES];
+    for (int j = 0; j < grid_width; ++j)
+    {
+        const uint32_t *cell_sums = &sub_sums[3 * SHAPE_FEATURES * static_cast<size_t>(j)];
+        const int *widths = &sub_width[SHAPE_SIZE * static_cast<size_t>(j)];
+
+        // the whole block's color, exactly as without shapes
+        uint64_t sum[3] = {0, 0, 0};
+        for (int k = 0; k < SHAPE_FEATURES; ++k)
+        {
+            sum[0] += cell_sums[3 * k];
+            sum[1] += cell_sums[3 * k + 1];
+            sum[2] += cell_sums[3 * k + 2];
+        }
+        const uint64_t count = static_cast<uint64_t>(block_height) * (widths[0] + widths[1] + widths[2] + widths[3]);
+        cv::Vec3b &color = colors[j];
+        color = cv::Vec3b(static_cast<uchar>((sum[0] + count / 2) / count),
+                          static_cast<uchar>((sum[1] + count / 2) / count),
+                          static_cast<uchar>((sum[2] + count / 2) / count));
+        const int cell_gray = (lut.weights[0] * color[0] + lut.weights[1] * color[1] + lut.weights[2] * color[2]) >> 8;
+
+        // the same weights straight on the sums, so a sub-block costs one division; an empty one, in a
+        // block less than SHAPE_SIZE pixels wide or high, takes the gray of the whole block
+        for (int r = 0; r < SHAPE_SIZE; ++r)
+        {
+            for (int c = 0; c < SHAPE_SIZE; ++c)
+            {
+                const int k = r * SHAPE_SIZE + c;
+                const uint64_t pixels = static_cast<uint64_t>(sub_height[r]) * widths[c];
+                const uint32_t *sub = cell_sums + 3 * k;
+                gray[k] = pixels ? static_cast<uint8_t>((lut.weights[0] * static_cast<uint64_t>(sub[0]) + lut.weights[1] * static_cast<uint64_t>(sub[1]) + lut.weights[2] * static_cast<uint64_t>(sub[2])) / (256 * pixels)) : cell_gray;
+            }
+        }
+        indices[j] = static_cast<uint8_t>(nearest_glyph(gray, cell_gray, lut.glyph_index[cell_gray], shapes));
+    }
+}
+
+void process_image_area(const cv::Mat &source, int source_total_rows, int first_cell_row, int end_cell_row, cv::Size grid, const LuminanceLut &lut, const GlyphAtlas &atlas, const GlyphShapes *shapes, const GlyphRenderer &renderer, ThreadPool &pool, char *ascii_art, cv::Mat &ascii_image, cv::Mat *cell_colors)
+{
+    const int line_length = grid.width + 1;
+    const int source_first_row = get_source_row_range(source_total_rows, grid.height, first_cell_row, end_cell_row).first;
+
+    // which cell every source column is averaged into, and how many columns each cell covers
+    std::vector<int> cell_of_column(source.cols);
+    std::vector<int> block_width(grid.width, 0);
+    for (int x = 0; x < source.cols; ++x)
+    {
+        cell_of_column[x] = static_cast<int>(static_cast<long long>(x) * grid.width / source.cols);
+        ++block_width[cell_of_column[x]];
+    }
+
+    // with shapes, where in its cell's sub-block sums every source column adds up, and how many columns
+    // each sub-column covers; sub-column s is column s % SHAPE_SIZE of cell s / SHAPE_SIZE
+    std::vector<int> sub_offset_of_column;
+    std::vector<int> sub_width;
+    if (shapes)
+    {
+        sub_offset_of_column.resize(source.cols);
+        sub_width.assign(SHAPE_SIZE * static_cast<size_t>(grid.width), 0);
+        for (int x = 0; x < source.cols; ++x)
+        {
+            const int sub_column = static_cast<int>(static_cast<long long>(x) * SHAPE_SIZE * grid.width / source.cols);
+            sub_offset_of_column[x] = 3 * ((sub_column / SHAPE_SIZE) * SHAPE_FEATURES + sub_column % SHAPE_SIZE);
+            ++sub_width[sub_column];
+        }
+    }
+
+    pool.parallel_for(0, end_cell_row - first_cell_row, [&](int band_begin, int band_end)
+                      {
+        std::vector<uint64_t> sums(3 * static_cast<size_t>(grid.width));
+        // BGR sums of every sub-block, SHAPE_FEATURES per cell row by row; a sub-block would need over
+        // 16 million pixels to overflow
+        std::vector<uint32_t> sub_sums(shapes ? 3 * SHAPE_FEATURES * static_cast<size_t>(grid.width) : 0);
+        std::vector<cv::Vec3b> colors(grid.width);
+        std::vector<uint8_t> indices(grid.width);
+        std::chrono::steady_clock::duration convert_time{0}, render_time{0};
+
+        for (int i = band_begin; i < band_end; ++i)
+        {
+            auto convert_start = std::chrono::steady_clock::now();
+            std::pair<int, int> block_rows = get_source_row_range(source_total_rows, grid.height, first_cell_row + i, first_cell_row + i + 1);
+            if (shapes)
+            {
+                convert_row_shapes(source, source_first_row, block_rows, grid.width, sub_offset_of_column, sub_width, lut, *shapes, sub_sums, colors, indices);
+            }
+            else
+            {
+                const uint64_t block_height = block_rows.second - block_rows.first;
+                std::fill(sums.begin(), sums.end(), 0);
+
+                // one pass over the block's pixels, accumulating into every cell of the row at once
+                for (int y = block_rows.first; y < block_rows.second; ++y)
+                {
+                    const uchar *src = source.ptr<uchar>(y - source_first_row);
+                    for (int x = 0; x < source.cols; ++x)
+                    {
+                        uint64_t *sum = &sums[3 * static_cast<size_t>(cell_of_column[x])];
+                        sum[0] += src[3 * x];
+                        sum[1] += src[3 * x + 1];
+                        sum[2] += src[3 * x + 2];
+                    }
+                }
+
+                for (int j = 0; j < grid.width; ++j)
+                {
+                    const uint64_t count = block_height * block_width[j];
+                    const uint64_t *sum = &sums[3 * static_cast<size_t>(j)];
+                    cv::Vec3b &color = colors[j];
+                    color = cv::Vec3b(static_cast<uchar>((sum[0] + count / 2) / count),
+                                      static_cast<uchar>((sum[1] + count / 2) / count),
+                                      static_cast<uchar>((sum[2] + count / 2) / count));
+
+                    // same fixed-point weights and table as row_to_glyph_indices
+                    int gray = (lut.weights[0] * color[0] + lut.weights[1] * color[1] + lut.weights[2] * color[2]) >> 8;
+                    indices[j] = lut.glyph_index[gray];
+                }
+            }
+            if (cell_colors)
+            {
+                std::copy(colors.begin(), colors.end(), cell_colors->ptr<cv::Vec3b>(i));
+            }
+
+            auto render_start = std::chrono::steady_clock::now();
+            renderer.kernel(ascii_image, i, atlas, indices.data(), colors.data(), grid.width);
+            char *line = &ascii_art[static_cast<size_t>(i) * line_length];
+            for (int j = 0; j < grid.width; ++j)
+            {
+                line[j] = atlas.characters[indices[j]];
+            }
+            line[grid.width] = '\n';
+
+            convert_time += render_start - convert_start;
+            render_time += std::chrono::steady_clock::now() - render_start;
+        }
+
+        profile_add(PHASE_CONVERT, convert_time);
+        profile_add(PHASE_RENDER, render_time); });
+}
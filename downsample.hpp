@@ -0,0 +1,34 @@
+#ifndef __DOWNSAMPLE_HPP__
+#define __DOWNSAMPLE_HPP__
+
+#include <string>
+#include <utility>
+#include <opencv2/opencv.hpp>
+
+#include "glyph_atlas.hpp"
+#include "glyph_shapes.hpp"
+#include "luminance.hpp"
+#include "thread_pool.hpp"
+
+// Size of the character grid for a desired width and height, after scale_factor and the
+// cell_width/cell_height aspect correction
+cv::Size get_grid_size(int desired_width, int desired_height, float scale_factor, int cell_width, int cell_height);
+
+// Source rows [start, end) averaged into cell rows [first_cell_row, end_cell_row) of a grid of grid_rows rows.
+// Cell row r covers source rows [r * source_rows / grid_rows, (r + 1) * source_rows / grid_rows), so the
+// ranges of consecutive cell rows never overlap when the grid is smaller than the source.
+std::pair<int, int> get_source_row_range(int source_rows, int grid_rows, int first_cell_row, int end_cell_row);
+
+// Convert cell rows [first_cell_row, end_cell_row) of a grid straight from the source pixels: every cell's
+// block of source pixels is averaged into one color, mapped to a glyph and drawn, with no resized copy of
+// the image in between. source holds the source rows returned by get_source_row_range for those cells,
+// out of source_total_rows rows in the whole image.
+// The text goes to ascii_art, (end_cell_row - first_cell_row) * (grid.width + 1) bytes, and the glyphs to
+// ascii_image by renderer, atlas.cell_height rows per cell row; both are written in place, so callers can hand in a
+// slice of a larger buffer. If cell_colors is set, the averaged color of every cell also goes to it, one
+// CV_8UC3 pixel per cell, sized like the cells.
+// If shapes is set, every cell's block is averaged into SHAPE_SIZE x SHAPE_SIZE sub-blocks as well, and the
+// glyph is the one whose shape matches their gray levels best instead of the one lut gives the cell's color.
+void process_image_area(const cv::Mat &source, int source_total_rows, int first_cell_row, int end_cell_row, cv::Size grid, const LuminanceLut &lut, const GlyphAtlas &atlas, const GlyphShapes *shapes, const GlyphRenderer &renderer, ThreadPool &pool, char *ascii_art, cv::Mat &ascii_image, cv::Mat *cell_colors);
+
+#endif // __DOWNSAMPLE_HPP__
@@ -0,0 +1,162 @@
+#include <cstring>
+#include <vector>
+
+#include "glyph_atlas.hpp"
+#include "constants.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+// the default cell, constants::CHARACTER_WIDTH x constants::CHARACTER_HEIGHT, as template arguments
+static const int DEFAULT_CELL_WIDTH = 10;
+static const int DEFAULT_CELL_HEIGHT = 18;
+
+// Rasterize every character once. Pixels a glyph would draw outside its own cell are clipped,
+// which is the only difference from drawing each cell with cv::putText.
+GlyphAtlas build_glyph_atlas(const std::string &characters, int cell_width, int cell_height)
+{
+    GlyphAtlas atlas;
+    atlas.cell_width = cell_width;
+    atlas.cell_height = cell_height;
+    atlas.num_glyphs = characters.size();
+    atlas.characters = characters;
+    atlas.masks = cv::Mat::zeros(cell_height * atlas.num_glyphs, cell_width, CV_8UC1);
+    atlas.white = cv::Mat::zeros(cell_height * atlas.num_glyphs, cell_width, CV_8UC3);
+
+    for (int i = 0; i < atlas.num_glyphs; ++i)
+    {
+        cv::Mat mask = atlas.masks.rowRange(i * cell_height, (i + 1) * cell_height);
+        cv::putText(mask, std::string(1, characters[i]), cv::Point(0, cell_height), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar::all(255), 1);
+
+        for (int y = 0; y < cell_height; ++y)
+        {
+            const uchar *src = mask.ptr<uchar>(y);
+            uchar *dst = atlas.white.ptr<uchar>(i * cell_height + y);
+            for (int x = 0; x < cell_width; ++x)
+            {
+                dst[3 * x] = dst[3 * x + 1] = dst[3 * x + 2] = src[x];
+            }
+        }
+    }
+
+    return atlas;
+}
+
+// Copy one glyph into its cell: a row-wise memcpy for white text, or the mask scaled by the cell color
+void blit_glyph(cv::Mat &ascii_image, int row, int col, const GlyphAtlas &atlas, int glyph_index, bool colored_flag, const cv::Vec3b &color)
+{
+    const int width = atlas.cell_width;
+    const int height = atlas.cell_height;
+    const int glyph_row = glyph_index * height;
+
+    for (int y = 0; y < height; ++y)
+    {
+        uchar *dst = ascii_image.ptr<uchar>(row * height + y) + 3 * col * width;
+
+        if (!colored_flag)
+        {
+            std::memcpy(dst, atlas.white.ptr<uchar>(glyph_row + y), 3 * width);
+            continue;
+        }
+
+        const uchar *mask = atlas.masks.ptr<uchar>(glyph_row + y);
+        for (int x = 0; x < width; ++x)
+        {
+            const int alpha = mask[x];
+            dst[3 * x] = static_cast<uchar>((color[0] * alpha + 127) / 255);
+            dst[3 * x + 1] = static_cast<uchar>((color[1] * alpha + 127) / 255);
+            dst[3 * x + 2] = static_cast<uchar>((color[2] * alpha + 127) / 255);
+        }
+    }
+}
+
+// dst[k] = (tint[k] * glyph[k] + 127) / 255 for k < n, the rounding of blit_glyph; (v + 127) / 255 is
+// (v + 128 + ((v + 128) >> 8)) >> 8 for every product of two bytes, which stays in 16 bits
+static void tint_bytes(uchar *dst, const uchar *glyph, const uint8_t *tint, int n)
+{
+    int k = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    for (; k + 16 <= n; k += 16)
+    {
+        const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(glyph + k));
+        const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tint + k));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(t, zero)), half);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(t, zero)), half);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + k), _mm_packus_epi16(lo, hi));
+    }
+#endif // __SSE2__
+    for (; k < n; ++k)
+    {
+        const uint16_t v = static_cast<uint16_t>(tint[k] * glyph[k] + 128);
+        dst[k] = static_cast<uchar>((v + (v >> 8)) >> 8);
+    }
+}
+
+// Draw a whole row of cells one pixel row at a time, so every destination row is written front to back.
+// CellWidth and CellHeight are 0 when they are only known at run time; otherwise every glyph row is a copy of
+// a fixed number of bytes, which the compiler inlines as a few loads and stores instead of calling memcpy.
+// Colored text gathers the glyph rows the same way into a scratch row, then tints the whole row at once
+// with the color of every cell repeated over its pixels.
+template <bool Colored, int CellWidth, int CellHeight>
+static void render_row(cv::Mat &ascii_image, int row, const GlyphAtlas &atlas, const uint8_t *indices, const cv::Vec3b *colors, int cols)
+{
+    const int width = CellWidth ? CellWidth : atlas.cell_width;
+    const int height = CellHeight ? CellHeight : atlas.cell_height;
+    const int cell_bytes = 3 * width;
+    const int row_bytes = cols * cell_bytes;
+    const size_t glyph_step = static_cast<size_t>(atlas.white.step) * height;
+
+    // scratch rows for the colored kernel, kept per thread and only ever grown, so rendering allocates only
+    // on a thread's first row or when the image gets wider
+    static thread_local std::vector<uint8_t> tints;
+    static thread_local std::vector<uchar> glyphs;
+    if (Colored && tints.size() < static_cast<size_t>(row_bytes))
+    {
+        tints.resize(row_bytes);
+        glyphs.resize(row_bytes);
+    }
+    for (int j = 0; Colored && j < cols; ++j)
+    {
+        uint8_t *tint = &tints[static_cast<size_t>(j) * cell_bytes];
+        for (int x = 0; x < width; ++x)
+        {
+            tint[3 * x] = colors[j][0];
+            tint[3 * x + 1] = colors[j][1];
+            tint[3 * x + 2] = colors[j][2];
+        }
+    }
+
+    for (int y = 0; y < height; ++y)
+    {
+        uchar *out = ascii_image.ptr<uchar>(row * height + y);
+        uchar *dst = Colored ? glyphs.data() : out;
+        const uchar *glyph_row = atlas.white.ptr<uchar>(y);
+        for (int j = 0; j < cols; ++j)
+        {
+            std::memcpy(dst, glyph_row + indices[j] * glyph_step, cell_bytes);
+            dst += cell_bytes;
+        }
+        if (Colored)
+        {
+            tint_bytes(out, glyphs.data(), tints.data(), row_bytes);
+        }
+    }
+}
+
+GlyphRenderer select_glyph_renderer(const GlyphAtlas &atlas, bool colored_flag)
+{
+    const bool default_cell = atlas.cell_width == DEFAULT_CELL_WIDTH && atlas.cell_height == DEFAULT_CELL_HEIGHT &&
+                              DEFAULT_CELL_WIDTH == constants::CHARACTER_WIDTH && DEFAULT_CELL_HEIGHT == constants::CHARACTER_HEIGHT;
+    if (default_cell)
+    {
+        return colored_flag ? GlyphRenderer{render_row<true, DEFAULT_CELL_WIDTH, DEFAULT_CELL_HEIGHT>, "colored 10x18"}
+                            : GlyphRenderer{render_row<false, DEFAULT_CELL_WIDTH, DEFAULT_CELL_HEIGHT>, "white 10x18"};
+    }
+    return colored_flag ? GlyphRenderer{render_row<true, 0, 0>, "colored any size"}
+                        : GlyphRenderer{render_row<false, 0, 0>, "white any size"};
+}
@@ -0,0 +1,40 @@
+#ifndef __GLYPH_ATLAS_HPP__
+#define __GLYPH_ATLAS_HPP__
+
+#include <cstdint>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+// Every character of the charset rasterized once into a cell of cell_width x cell_height pixels.
+// Glyph i occupies rows [i * cell_height, (i + 1) * cell_height) of both mats.
+struct GlyphAtlas
+{
+    int cell_width = 0;
+    int cell_height = 0;
+    int num_glyphs = 0;
+    std::string characters; // the character of each glyph, for the text output
+    cv::Mat masks; // CV_8UC1 coverage of each glyph, 0 or 255
+    cv::Mat white; // CV_8UC3 white-on-black rendering of each glyph, copied as-is for monochrome output
+};
+
+// rasterize each character with the same font settings process_image used to draw with
+GlyphAtlas build_glyph_atlas(const std::string &characters, int cell_width, int cell_height);
+
+// copy glyph glyph_index into the cell at (row, col) of ascii_image, tinted with color if colored_flag is set
+void blit_glyph(cv::Mat &ascii_image, int row, int col, const GlyphAtlas &atlas, int glyph_index, bool colored_flag, const cv::Vec3b &color);
+
+// draws glyph indices[j] into cell (row, j) of ascii_image for every j < cols, tinted with colors[j] when colored
+typedef void (*RenderRowKernel)(cv::Mat &ascii_image, int row, const GlyphAtlas &atlas, const uint8_t *indices, const cv::Vec3b *colors, int cols);
+
+// The row kernel for one atlas and color mode, instantiated at compile time for white or colored text and for
+// the default cell size, so the glyph copies unroll to fixed-size loads and stores. Picked once per run.
+struct GlyphRenderer
+{
+    RenderRowKernel kernel;
+    const char *kernel_name;
+};
+
+// pick the kernel for atlas; any cell size other than the default gets one with the size read at run time
+GlyphRenderer select_glyph_renderer(const GlyphAtlas &atlas, bool colored_flag);
+
+#endif // __GLYPH_ATLAS_HPP__
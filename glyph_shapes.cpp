@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+#include "glyph_shapes.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHAPES_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SHAPES_NEON
+#endif
+
+// glyphs compared at once by the vector kernels, and the padding of the features
+static const int GLYPH_GROUP = 8;
+
+int nearest_glyph_scalar(const uint8_t *target, uint16_t tone, const uint8_t *features, const uint16_t *tones, int num_glyphs)
+{
+    int best = 0;
+    int best_distance = INT_MAX;
+    for (int g = 0; g < num_glyphs; ++g)
+    {
+        const uint8_t *feature = features + g * SHAPE_FEATURES;
+        int distance = std::abs(tones[g] - tone);
+        for (int k = 0; k < SHAPE_FEATURES; ++k)
+        {
+            distance += std::abs(target[k] - feature[k]);
+        }
+        if (distance < best_distance)
+        {
+            best_distance = distance;
+            best = g;
+        }
+    }
+    return best;
+}
+
+#ifdef SHAPES_X86
+// The 16 features of a glyph fill one register, so one psadbw gives its distance in two halves. Eight
+// distances (at most 16 * 255 plus the tone term, so they fit in 16 bits) are packed into one register with
+// their tone differences added, and phminposuw finds the smallest and its lane, the lowest on a tie.
+__attribute__((target("sse4.1"))) static int nearest_glyph_sse41(const uint8_t *target, uint16_t tone, const uint8_t *features, const uint16_t *tones, int num_glyphs)
+{
+    const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(target));
+    const __m128i cell_tone = _mm_set1_epi16(static_cast<short>(tone));
+    int best = 0;
+    int best_distance = INT_MAX;
+
+    // the padding repeats the last glyph, which only ever ties with it at a higher index
+    for (int g = 0; g < num_glyphs; g += GLYPH_GROUP)
+    {
+        __m128i d[GLYPH_GROUP];
+        for (int i = 0; i < GLYPH_GROUP; ++i)
+        {
+            __m128i sad = _mm_sad_epu8(t, _mm_loadu_si128(reinterpret_cast<const __m128i *>(features + (g + i) * SHAPE_FEATURES)));
+            d[i] = _mm_add_epi16(sad, _mm_srli_si128(sad, 8));
+        }
+        // gather the low word of every d[i] into lane i
+        const __m128i d01 = _mm_unpacklo_epi16(d[0], d[1]);
+        const __m128i d23 = _mm_unpacklo_epi16(d[2], d[3]);
+        const __m128i d45 = _mm_unpacklo_epi16(d[4], d[5]);
+        const __m128i d67 = _mm_unpacklo_epi16(d[6], d[7]);
+        __m128i distances = _mm_unpacklo_epi64(_mm_unpacklo_epi32(d01, d23), _mm_unpacklo_epi32(d45, d67));
+        distances = _mm_add_epi16(distances, _mm_abs_epi16(_mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(tones + g)), cell_tone)));
+
+        const int minimum = _mm_cvtsi128_si32(_mm_minpos_epu16(distances));
+        if ((minimum & 0xffff) < best_distance)
+        {
+            best_distance = minimum & 0xffff;
+            best = g + (minimum >> 16);
+        }
+    }
+    return best;
+}
+
+// The same with two glyphs per 256-bit psadbw, so eight take four
+__attribute__((target("avx2"))) static int nearest_glyph_avx2(const uint8_t *target, uint16_t tone, const uint8_t *features, const uint16_t *tones, int num_glyphs)
+{
+    const __m256i t = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(target)));
+    const __m128i cell_tone = _mm_set1_epi16(static_cast<short>(tone));
+    int best = 0;
+    int best_distance = INT_MAX;
+
+    for (int g = 0; g < num_glyphs; g += GLYPH_GROUP)
+    {
+        // d[i] holds the distance of glyph 2i in word 0 and of glyph 2i + 1 in word 8
+        __m256i d[GLYPH_GROUP / 2];
+        for (int i = 0; i < GLYPH_GROUP / 2; ++i)
+        {
+            __m256i sad = _mm256_sad_epu8(t, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(features + (g + 2 * i) * SHAPE_FEATURES)));
+            d[i] = _mm256_add_epi16(sad, _mm256_srli_si256(sad, 8));
+        }
+        // the unpacks work within 128-bit halves, which leaves glyphs 0, 2, 4, 6 in words 0..3 of the low
+        // half and 1, 3, 5, 7 in those of the high half; interleaving the halves puts them in order
+        const __m256i d01 = _mm256_unpacklo_epi16(d[0], d[1]);
+        const __m256i d23 = _mm256_unpacklo_epi16(d[2], d[3]);
+        const __m256i d0123 = _mm256_unpacklo_epi32(d01, d23);
+        const __m128i even = _mm256_castsi256_si128(d0123);
+        const __m128i odd = _mm256_extracti128_si256(d0123, 1);
+        __m128i distances = _mm_unpacklo_epi16(even, odd);
+        distances = _mm_add_epi16(distances, _mm_abs_epi16(_mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(tones + g)), cell_tone)));
+
+        const int minimum = _mm_cvtsi128_si32(_mm_minpos_epu16(distances));
+        if ((minimum & 0xffff) < best_distance)
+        {
+            best_distance = minimum & 0xffff;
+            best = g + (minimum >> 16);
+        }
+    }
+    return best;
+}
+#endif // SHAPES_X86
+
+#ifdef SHAPES_NEON
+static int nearest_glyph_neon(const uint8_t *target, uint16_t tone, const uint8_t *features, const uint16_t *tones, int num_glyphs)
+{
+    const uint8x16_t t = vld1q_u8(target);
+    int best = 0;
+    int best_distance = INT_MAX;
+    for (int g = 0; g < num_glyphs; ++g)
+    {
+        const int distance = vaddlvq_u8(vabdq_u8(t, vld1q_u8(features + g * SHAPE_FEATURES))) + std::abs(tones[g] - tone);
+        if (distance < best_distance)
+        {
+            best_distance = distance;
+            best = g;
+        }
+    }
+    return best;
+}
+#endif // SHAPES_NEON
+
+// pick the widest kernel the CPU supports
+static void select_kernel(GlyphShapes &shapes)
+{
+#if defined(SHAPES_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        shapes.kernel = nearest_glyph_avx2;
+        shapes.kernel_name = "avx2";
+        return;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        shapes.kernel = nearest_glyph_sse41;
+        shapes.kernel_name = "sse4.1";
+        return;
+    }
+#elif defined(SHAPES_NEON)
+    shapes.kernel = nearest_glyph_neon;
+    shapes.kernel_name = "neon";
+    return;
+#endif
+    shapes.kernel = nearest_glyph_scalar;
+    shapes.kernel_name = "scalar";
+}
+
+// the lowest gray level build_luminance_lut maps to glyph g of num_glyphs, or 256 past the last one
+static int lowest_gray(int g, int num_glyphs)
+{
+    if (g >= num_glyphs)
+    {
+        return 256;
+    }
+    return (num_glyphs > 1) ? (g * 255 + num_glyphs - 2) / (num_glyphs - 1) : 0;
+}
+
+// Average every glyph's mask over its sub-blocks. Pixel (y, x) of a cell falls in sub-block
+// (y * SHAPE_SIZE / height, x * SHAPE_SIZE / width), as the source pixels of a cell do; a sub-block with no
+// pixels, in a cell less than SHAPE_SIZE wide or high, takes the mean of the whole glyph. Only how the coverage
+// varies across the cell is kept: the glyph's brightness is its place in the charset, as the luminance table has it.
+GlyphShapes build_glyph_shapes(const GlyphAtlas &atlas, bool negate_flag)
+{
+    GlyphShapes shapes;
+    shapes.num_glyphs = atlas.num_glyphs;
+    shapes.negate_flag = negate_flag;
+    const int padded = (atlas.num_glyphs + GLYPH_GROUP - 1) / GLYPH_GROUP * GLYPH_GROUP;
+    shapes.features.assign(static_cast<size_t>(padded) * SHAPE_FEATURES, 128);
+    shapes.tones.assign(padded, 0);
+
+    for (int g = 0; g < atlas.num_glyphs; ++g)
+    {
+        int sums[SHAPE_FEATURES] = {0};
+        int counts[SHAPE_FEATURES] = {0};
+        int total = 0;
+        for (int y = 0; y < atlas.cell_height; ++y)
+        {
+            const uchar *mask = atlas.masks.ptr<uchar>(g * atlas.cell_height + y);
+            for (int x = 0; x < atlas.cell_width; ++x)
+            {
+                const int k = (y * SHAPE_SIZE / atlas.cell_height) * SHAPE_SIZE + x * SHAPE_SIZE / atlas.cell_width;
+                sums[k] += mask[x];
+                ++counts[k];
+                total += mask[x];
+            }
+        }
+
+        const int cell_pixels = atlas.cell_width * atlas.cell_height;
+        const int mean = (total + cell_pixels / 2) / cell_pixels;
+        int coverage[SHAPE_FEATURES];
+        int largest = 0;
+        for (int k = 0; k < SHAPE_FEATURES; ++k)
+        {
+            coverage[k] = counts[k] ? (sums[k] + counts[k] / 2) / counts[k] : mean;
+            largest = std::max(largest, std::abs(coverage[k] - mean));
+        }
+
+        uint8_t *feature = &shapes.features[static_cast<size_t>(g) * SHAPE_FEATURES];
+        const int scale = largest ? (127 << 16) / largest : 0;
+        for (int k = 0; k < SHAPE_FEATURES; ++k)
+        {
+            feature[k] = shape_feature(coverage[k] - mean, scale);
+        }
+        shapes.tones[g] = static_cast<uint16_t>(SHAPE_TONE_WEIGHT * (lowest_gray(g, atlas.num_glyphs) + lowest_gray(g + 1, atlas.num_glyphs) - 1) / 2);
+    }
+    for (int g = atlas.num_glyphs; g < padded; ++g)
+    {
+        std::copy_n(&shapes.features[static_cast<size_t>(atlas.num_glyphs - 1) * SHAPE_FEATURES], SHAPE_FEATURES, &shapes.features[static_cast<size_t>(g) * SHAPE_FEATURES]);
+        shapes.tones[g] = shapes.tones[atlas.num_glyphs - 1];
+    }
+
+    select_kernel(shapes);
+
+    return shapes;
+}
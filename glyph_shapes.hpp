@@ -0,0 +1,81 @@
+#ifndef __GLYPH_SHAPES_HPP__
+#define __GLYPH_SHAPES_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "glyph_atlas.hpp"
+
+// cells and glyphs are compared over SHAPE_SIZE x SHAPE_SIZE sub-blocks, one byte each
+static const int SHAPE_SIZE = 4;
+static const int SHAPE_FEATURES = SHAPE_SIZE * SHAPE_SIZE;
+// a cell whose sub-blocks differ by fewer gray levels than this has no shape, and keeps the glyph of its brightness
+static const int SHAPE_MIN_CONTRAST = 48;
+// cost of one gray level between a cell and the brightness a glyph stands for, against one unit of shape difference
+static const int SHAPE_TONE_WEIGHT = 8;
+
+// index of the glyph nearest to a cell: the sum of absolute differences between target and a glyph's features,
+// plus the distance between tone and the glyph's tone
+typedef int (*NearestGlyphKernel)(const uint8_t *target, uint16_t tone, const uint8_t *features, const uint16_t *tones, int num_glyphs);
+
+// Everything needed to pick glyphs by shape rather than by brightness alone, built once per run
+struct GlyphShapes
+{
+    int num_glyphs = 0;
+    // the shape of every glyph, in atlas order: the coverage of each sub-block minus the glyph's mean, scaled so
+    // the largest difference is 127 and centered on 128, SHAPE_FEATURES bytes row by row (all 128 for a blank)
+    std::vector<uint8_t> features;
+    // the gray level the luminance table maps to every glyph, times SHAPE_TONE_WEIGHT
+    std::vector<uint16_t> tones;
+    // glyphs are white on black, so ink matches the bright parts of a cell unless negated
+    bool negate_flag = false;
+    // fastest search kernel supported by the CPU we are running on
+    NearestGlyphKernel kernel;
+    const char *kernel_name;
+};
+
+// Downsample every glyph of atlas to its features. features and tones are padded with copies of the last glyph
+// to a multiple of 8 glyphs for the vector kernels.
+GlyphShapes build_glyph_shapes(const GlyphAtlas &atlas, bool negate_flag);
+
+// a sub-block's difference from the mean of its cell or glyph as a feature byte, with scale = (127 << 16) / the
+// largest difference in the cell, so that one becomes 127; rounded half away from zero and centered on 128
+inline uint8_t shape_feature(int difference, int scale)
+{
+    const int magnitude = ((difference < 0 ? -difference : difference) * scale + (1 << 15)) >> 16;
+    return static_cast<uint8_t>(128 + (difference < 0 ? -magnitude : magnitude));
+}
+
+// The glyph for a cell, given the gray levels of its sub-blocks row by row and the gray level of the whole cell.
+// A cell without contrast gets flat_glyph, the one the luminance table gives cell_gray. Otherwise the cell's
+// sub-blocks are scaled like the glyph features and the shape and brightness are weighed together, so a glyph
+// with the right shape wins over its neighbours in the charset. Ties go to the lowest index.
+inline int nearest_glyph(const uint8_t *gray, int cell_gray, int flat_glyph, const GlyphShapes &shapes)
+{
+    int sum = 0, low = 255, high = 0;
+    for (int k = 0; k < SHAPE_FEATURES; ++k)
+    {
+        sum += gray[k];
+        low = gray[k] < low ? gray[k] : low;
+        high = gray[k] > high ? gray[k] : high;
+    }
+    if (high - low < SHAPE_MIN_CONTRAST)
+    {
+        return flat_glyph;
+    }
+
+    const int mean = (sum + SHAPE_FEATURES / 2) / SHAPE_FEATURES;
+    const int largest = (high - mean > mean - low) ? high - mean : mean - low;
+    const int scale = (127 << 16) / largest;
+    uint8_t target[SHAPE_FEATURES];
+    for (int k = 0; k < SHAPE_FEATURES; ++k)
+    {
+        target[k] = shape_feature(shapes.negate_flag ? mean - gray[k] : gray[k] - mean, scale);
+    }
+    return shapes.kernel(target, static_cast<uint16_t>(SHAPE_TONE_WEIGHT * cell_gray), shapes.features.data(), shapes.tones.data(), shapes.num_glyphs);
+}
+
+// the portable kernel every vector kernel must agree with
+int nearest_glyph_scalar(const uint8_t *target, uint16_t tone, const uint8_t *features, const uint16_t *tones, int num_glyphs);
+
+#endif // __GLYPH_SHAPES_HPP__
@@ -0,0 +1,99 @@
+#include <cstring>
+
+#include "grid_file.hpp"
+
+static const char GRID_MAGIC[4] = {'A', 'G', 'R', 'D'};
+// bytes of the header before the charset
+static const size_t GRID_FIXED_HEADER = 22;
+
+static void append_le(std::string &out, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        out += static_cast<char>(value >> (8 * i));
+    }
+}
+
+static uint32_t read_le(const unsigned char *bytes, int count)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        value |= static_cast<uint32_t>(bytes[i]) << (8 * i);
+    }
+    return value;
+}
+
+std::string grid_file_header(int cols, int rows, int cell_width, int cell_height, const std::string &characters, int flags)
+{
+    // the planes start 8-byte aligned
+    size_t header_size = (GRID_FIXED_HEADER + characters.size() + 7) / 8 * 8;
+
+    std::string header(GRID_MAGIC, sizeof(GRID_MAGIC));
+    header += static_cast<char>(GRID_VERSION);
+    header += static_cast<char>(flags);
+    append_le(header, header_size, 2);
+    append_le(header, cols, 4);
+    append_le(header, rows, 4);
+    append_le(header, cell_width, 2);
+    append_le(header, cell_height, 2);
+    append_le(header, characters.size(), 2);
+    header += characters;
+    header.resize(header_size, '\0');
+    return header;
+}
+
+bool GridFile::open(const std::string &path)
+{
+    glyph_plane = color_plane = nullptr;
+    if (!file.open(path) || file.size() < GRID_FIXED_HEADER)
+    {
+        return false;
+    }
+
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(file.data());
+    if (std::memcmp(bytes, GRID_MAGIC, sizeof(GRID_MAGIC)) != 0 || bytes[4] != GRID_VERSION)
+    {
+        return false;
+    }
+    grid_flags = bytes[5];
+    size_t header_size = read_le(bytes + 6, 2);
+    num_cols = read_le(bytes + 8, 4);
+    num_rows = read_le(bytes + 12, 4);
+    cell_size[0] = read_le(bytes + 16, 2);
+    cell_size[1] = read_le(bytes + 18, 2);
+    size_t charset_length = read_le(bytes + 20, 2);
+
+    // the charset and both planes must fit in the file
+    size_t cells = static_cast<size_t>(num_rows) * num_cols;
+    size_t expected = header_size + cells * (has_colors() ? 4 : 1);
+    if (charset_length == 0 || charset_length > 256 || GRID_FIXED_HEADER + charset_length > header_size || file.size() < expected)
+    {
+        return false;
+    }
+    charset.assign(file.data() + GRID_FIXED_HEADER, charset_length);
+    for (int i = 0; i < 256; ++i)
+    {
+        glyph_characters[i] = charset[i % charset_length];
+    }
+
+    glyph_plane = bytes + header_size;
+    color_plane = has_colors() ? glyph_plane + cells : nullptr;
+    return true;
+}
+
+std::string GridFile::text(int first_row, int end_row, int first_col, int end_col) const
+{
+    const int width = end_col - first_col;
+    std::string out(static_cast<size_t>(end_row - first_row) * (width + 1), '\n');
+    char *line = &out[0];
+    for (int row = first_row; row < end_row; ++row, line += width + 1)
+    {
+        const uint8_t *indices = glyphs(row) + first_col;
+        for (int col = 0; col < width; ++col)
+        {
+            line[col] = glyph_characters[indices[col]];
+        }
+    }
+    return out;
+}
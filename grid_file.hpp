@@ -0,0 +1,87 @@
+#ifndef __GRID_FILE_HPP__
+#define __GRID_FILE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "mapped_file.hpp"
+
+// What a glyph grid file holds besides the glyphs, and the options it was converted with
+enum GridFlag
+{
+    GRID_COLORS = 1, // an RGB plane follows the glyph plane
+    GRID_NEGATE = 2,
+    GRID_REC601 = 4,
+    GRID_AREA = 8,
+    GRID_SHAPE = 16
+};
+
+// Compact binary output (.grid): the glyph and color of every cell, with no rendering, so tools can
+// re-render or query the art without parsing text or decoding the PNG. About 4 bytes per cell with colors.
+//
+// Layout (little endian):
+//   header:      "AGRD", u8 version, u8 flags (GridFlag), u16 header size, u32 cols, u32 rows,
+//                u16 cell width, u16 cell height, u16 charset length, the charset in glyph index order,
+//                zero padding up to the header size, a multiple of 8
+//   glyph plane: rows * cols u8 glyph indices, row by row
+//   color plane: rows * cols * 3 RGB bytes, row by row, only with GRID_COLORS
+// Every plane is at a fixed offset, so any range of rows can be written or read on its own.
+static const uint8_t GRID_VERSION = 1;
+
+// the header of a grid of cols x rows cells whose glyph indices refer to characters
+std::string grid_file_header(int cols, int rows, int cell_width, int cell_height, const std::string &characters, int flags);
+
+// offset of the glyph of cell (row, col)
+inline long long grid_glyph_offset(size_t header_size, int cols, int row, int col)
+{
+    return header_size + static_cast<long long>(row) * cols + col;
+}
+
+// offset of the RGB of cell (row, col)
+inline long long grid_color_offset(size_t header_size, int cols, int rows, int row, int col)
+{
+    return header_size + static_cast<long long>(rows) * cols + 3 * (static_cast<long long>(row) * cols + col);
+}
+
+// Random access to the cells of a grid file, read in place from a read-only mapping
+class GridFile
+{
+public:
+    // returns false if the file cannot be mapped, or is not a complete grid file of a known version
+    bool open(const std::string &path);
+
+    int cols() const { return num_cols; }
+    int rows() const { return num_rows; }
+    int flags() const { return grid_flags; }
+    bool has_colors() const { return grid_flags & GRID_COLORS; }
+    int cell_width() const { return cell_size[0]; }
+    int cell_height() const { return cell_size[1]; }
+    // the character of every glyph index
+    const std::string &characters() const { return charset; }
+
+    // the cols glyph indices of a row
+    const uint8_t *glyphs(int row) const { return glyph_plane + static_cast<size_t>(row) * num_cols; }
+
+    // the 3 * cols RGB bytes of a row, or null without colors
+    const uint8_t *colors(int row) const { return color_plane ? color_plane + 3 * static_cast<size_t>(row) * num_cols : nullptr; }
+
+    char character(int row, int col) const { return glyph_characters[glyphs(row)[col]]; }
+
+    // the text of cells [first_col, end_col) of rows [first_row, end_row), a newline after every row
+    std::string text(int first_row, int end_row, int first_col, int end_col) const;
+
+private:
+    MappedFile file;
+    int num_cols = 0;
+    int num_rows = 0;
+    int grid_flags = 0;
+    int cell_size[2] = {0, 0};
+    std::string charset;
+    // the charset repeated out to every byte value, so a damaged glyph plane cannot index past it
+    char glyph_characters[256];
+    const uint8_t *glyph_plane = nullptr;
+    const uint8_t *color_plane = nullptr;
+};
+
+#endif // __GRID_FILE_HPP__
@@ -3,13 +3,13 @@
 #include <opencv2/opencv.hpp>
 
 #include "image_processing.hpp"
-#include "constants.hpp"
-
-using namespace constants;
+#include "utils.hpp"
+#include "profiler.hpp"
 
 // Load an image from the input file path
 cv::Mat load_image(const std::string &input_filepath)
 {
+    ScopedPhase phase(PHASE_LOAD);
     cv::Mat image = cv::imread(input_filepath, cv::IMREAD_COLOR);
 
     if (image.empty())
@@ -20,57 +20,59 @@ cv::Mat load_image(const std::string &input_filepath)
     return image;
 }
 
-// resize the image to the desired width and height
-void resize_image(cv::Mat &image, int &desired_width, int &desired_height)
+// resize the image to one pixel per cell of the grid
+void resize_image(cv::Mat &image, cv::Size grid)
 {
-    cv::resize(image, image, cv::Size(static_cast<int>(desired_width * SCALE_FACTOR), static_cast<int>(desired_height * SCALE_FACTOR * (static_cast<float>(CHARACTER_WIDTH) / CHARACTER_HEIGHT))));
+    ScopedPhase phase(PHASE_RESIZE);
+    cv::resize(image, image, grid);
 }
 
 // Split the image into equal parts for each rank
 cv::Mat split_image(const cv::Mat &full_image, int my_rank, int num_ranks)
 {
-    int rows = full_image.rows;
-    int rows_per_rank = rows / num_ranks;
-    int remainder = rows % num_ranks;
-
-    int start_row = my_rank * rows_per_rank + std::min(my_rank, remainder);
-    int end_row = start_row + rows_per_rank - 1;
-    if (my_rank < remainder)
-    {
-        end_row++;
-    }
-
-    // Ensure end_row does not exceed the last row of the image
-    end_row = std::min(end_row, rows - 1);
+    std::pair<int, int> range = get_row_range(full_image.rows, my_rank, num_ranks);
 
-    return full_image.rowRange(start_row, end_row + 1).clone();
+    return full_image.rowRange(range.first, range.second).clone();
 }
 
-// Process the image to get the ASCII art string and the ASCII image
-std::pair<std::string, cv::Mat> process_image(const cv::Mat &image, bool colored_flag)
+// Process the image to get the ASCII art string and the ASCII image.
+// Rows are split into one band per pool thread; each band fills its own slice of both outputs.
+// The pixels of a row are the colors of its cells, so they go to the renderer as they are.
+std::pair<std::string, cv::Mat> process_image(const cv::Mat &image, const LuminanceLut &lut, const GlyphAtlas &atlas, const GlyphRenderer &renderer, ThreadPool &pool)
 {
-    std::string ascii_art;
-    cv::Mat ascii_image(CHARACTER_HEIGHT * image.rows, CHARACTER_WIDTH * image.cols, image.type());
-
-    for (int i = 0; i < image.rows; i++)
-    {
-        for (int j = 0; j < image.cols; j++)
+    const int line_length = image.cols + 1;
+    std::string ascii_art(static_cast<size_t>(image.rows) * line_length, '\n');
+    cv::Mat ascii_image(atlas.cell_height * image.rows, atlas.cell_width * image.cols, image.type());
+    profile_count_allocation(ascii_art.size());
+    profile_count_allocation(ascii_image.total() * ascii_image.elemSize());
+
+    pool.parallel_for(0, image.rows, [&](int start_row, int end_row)
+                      {
+        std::vector<uint8_t> glyph_indices(image.cols);
+        std::chrono::steady_clock::duration convert_time{0}, render_time{0};
+
+        for (int i = start_row; i < end_row; i++)
         {
-            cv::Vec3b pixel = image.at<cv::Vec3b>(i, j);
+            const cv::Vec3b *row = image.ptr<cv::Vec3b>(i);
+            char *line = &ascii_art[static_cast<size_t>(i) * line_length];
 
             // Magic 🧙🏻🧙🏻‍♂️🧙🏻‍♀️
-            float gray = 0.299 * pixel[0] + 0.587 * pixel[1] + 0.114 * pixel[2];
-            int index = static_cast<int>(gray * (CHARACTERS.size() - 1) / 255);
-            char asciiChar = CHARACTERS[index];
-
-            cv::Scalar textColor = (colored_flag) ? cv::Scalar(pixel[0], pixel[1], pixel[2]) : cv::Scalar::all(255);
-            cv::putText(ascii_image, std::string(1, asciiChar), cv::Point(j * CHARACTER_WIDTH, i * CHARACTER_HEIGHT + CHARACTER_HEIGHT), cv::FONT_HERSHEY_SIMPLEX, 0.5, textColor, 1);
-
-            ascii_art += asciiChar;
+            auto convert_start = std::chrono::steady_clock::now();
+            row_to_glyph_indices(row, image.cols, lut, glyph_indices.data());
+            auto render_start = std::chrono::steady_clock::now();
+
+            renderer.kernel(ascii_image, i, atlas, glyph_indices.data(), row, image.cols);
+            for (int j = 0; j < image.cols; j++)
+            {
+                line[j] = atlas.characters[glyph_indices[j]];
+            }
+
+            convert_time += render_start - convert_start;
+            render_time += std::chrono::steady_clock::now() - render_start;
         }
 
-        ascii_art += '\n';
-    }
+        profile_add(PHASE_CONVERT, convert_time);
+        profile_add(PHASE_RENDER, render_time); });
 
-    return {ascii_art, ascii_image};
+    return {std::move(ascii_art), ascii_image};
 }
\ No newline at end of file
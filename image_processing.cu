@@ -5,9 +5,8 @@
 #include <opencv2/opencv.hpp>
 
 #include "image_processing.hpp"
-#include "constants.hpp"
-
-using namespace constants;
+#include "utils.hpp"
+#include "profiler.hpp"
 
 int cudaDeviceCount;
 cudaError_t cE;
@@ -33,6 +32,7 @@ void map_rank_to_gpu(int my_rank)
 // Load an image from the input file path
 cv::Mat load_image(const std::string &input_filepath)
 {
+    ScopedPhase phase(PHASE_LOAD);
     cv::Mat image = cv::imread(input_filepath, cv::IMREAD_COLOR);
 
     if (image.empty())
@@ -43,34 +43,23 @@ cv::Mat load_image(const std::string &input_filepath)
     return image;
 }
 
-// resize the image to the desired width and height
-void resize_image(cv::Mat &image, int &desired_width, int &desired_height)
+// resize the image to one pixel per cell of the grid
+void resize_image(cv::Mat &image, cv::Size grid)
 {
-    cv::resize(image, image, cv::Size(static_cast<int>(desired_width * SCALE_FACTOR), static_cast<int>(desired_height * SCALE_FACTOR * (static_cast<float>(CHARACTER_WIDTH) / CHARACTER_HEIGHT))));
+    ScopedPhase phase(PHASE_RESIZE);
+    cv::resize(image, image, grid);
 }
 
 // Split the image into equal parts for each rank
 cv::Mat split_image(const cv::Mat &full_image, int my_rank, int num_ranks)
 {
-    int rows = full_image.rows;
-    int rows_per_rank = rows / num_ranks;
-    int remainder = rows % num_ranks;
-
-    int start_row = my_rank * rows_per_rank + std::min(my_rank, remainder);
-    int end_row = start_row + rows_per_rank - 1;
-    if (my_rank < remainder)
-    {
-        end_row++;
-    }
-
-    // Ensure end_row does not exceed the last row of the image
-    end_row = std::min(end_row, rows - 1);
+    std::pair<int, int> range = get_row_range(full_image.rows, my_rank, num_ranks);
 
-    return full_image.rowRange(start_row, end_row + 1).clone();
+    return full_image.rowRange(range.first, range.second).clone();
 }
 
 // Convert the image to ASCII art
-__global__ void imageToAsciiKernel(cv::cuda::PtrStepSz<uchar3> input, char *output, int width, const char *device_characters, int num_chats)
+__global__ void imageToAsciiKernel(cv::cuda::PtrStepSz<uchar3> input, unsigned char *output, int width, int num_chats, ushort3 weights)
 {
     int x = blockIdx.x * blockDim.x + threadIdx.x;
     int y = blockIdx.y * blockDim.y + threadIdx.y;
@@ -79,65 +68,59 @@ __global__ void imageToAsciiKernel(cv::cuda::PtrStepSz<uchar3> input, char *outp
     {
         uchar3 pixel = input(y, x);
         // Magic 🧙🏻🧙🏻‍♂️🧙🏻‍♀️
-        float gray = 0.299f * pixel.x + 0.587f * pixel.y + 0.114f * pixel.z;
-        int index = static_cast<int>(gray * (num_chats - 1) / 255);
+        // same fixed-point weights as the CPU luminance table
+        int gray = (weights.x * pixel.x + weights.y * pixel.y + weights.z * pixel.z) >> 8;
+        int index = gray * (num_chats - 1) / 255;
         index = max(0, min(index, num_chats - 1));
-        char ascii_char = device_characters[index];
 
-        output[y * width + x] = ascii_char;
+        output[y * width + x] = static_cast<unsigned char>(index);
     }
 }
 
 // Process the image on the GPU and return the ASCII art and the ASCII image
-std::pair<std::string, cv::Mat> process_image(const cv::Mat &image, bool colored_flag, int threads_x, int threads_y)
+std::pair<std::string, cv::Mat> process_image(const cv::Mat &image, const LuminanceLut &lut, const GlyphAtlas &atlas, const GlyphRenderer &renderer, int threads_x, int threads_y)
 {
+    auto convert_start = std::chrono::steady_clock::now();
     cv::cuda::GpuMat d_image(image);
     size_t num_chars = image.rows * image.cols;
-    char *d_ascii_art;
-    cudaMalloc(&d_ascii_art, sizeof(char) * num_chars);
-
-    // Transfer CHARACTERS to device
-    const char *device_characters;
-    size_t char_size = CHARACTERS.size();
-    cudaMalloc(&device_characters, char_size);
-    cudaMemcpy((void *)device_characters, CHARACTERS.c_str(), char_size, cudaMemcpyHostToDevice);
+    unsigned char *d_glyph_indices;
+    cudaMalloc(&d_glyph_indices, sizeof(unsigned char) * num_chars);
+    size_t char_size = atlas.num_glyphs;
 
     dim3 threads_per_block(threads_x, threads_y);
     dim3 num_blocks((image.cols + threads_per_block.x - 1) / threads_per_block.x,
                     (image.rows + threads_per_block.y - 1) / threads_per_block.y);
 
-    imageToAsciiKernel<<<num_blocks, threads_per_block>>>(d_image, d_ascii_art, image.cols, device_characters, char_size);
+    imageToAsciiKernel<<<num_blocks, threads_per_block>>>(d_image, d_glyph_indices, image.cols, char_size, make_ushort3(lut.weights[0], lut.weights[1], lut.weights[2]));
     cudaDeviceSynchronize();
 
-    // Copy the ASCII art from device to host
-    std::vector<char> ascii_art(num_chars);
-    cudaMemcpy(&ascii_art[0], d_ascii_art, sizeof(char) * num_chars, cudaMemcpyDeviceToHost);
+    // Copy the glyph indices from device to host
+    std::vector<unsigned char> glyph_indices(num_chars);
+    cudaMemcpy(&glyph_indices[0], d_glyph_indices, sizeof(unsigned char) * num_chars, cudaMemcpyDeviceToHost);
 
-    std::string ascii_art_str;
-    // Extra space for newlines
-    ascii_art_str.reserve(num_chars + image.rows);
-    for (int i = 0; i < image.rows; ++i)
-    {
-        ascii_art_str.append(&ascii_art[i * image.cols], image.cols);
-        ascii_art_str.push_back('\n');
-    }
+    cudaFree(d_glyph_indices);
+    profile_add(PHASE_CONVERT, std::chrono::steady_clock::now() - convert_start);
+    ScopedPhase render_phase(PHASE_RENDER);
 
-    cudaFree(d_ascii_art);
+    // one line per row plus its newline, written in place
+    const int line_length = image.cols + 1;
+    std::string ascii_art_str(static_cast<size_t>(image.rows) * line_length, '\n');
 
     // Handling the drawing on host
-    cv::Mat ascii_image = cv::Mat::zeros(image.rows * CHARACTER_HEIGHT, image.cols * CHARACTER_WIDTH, CV_8UC3);
+    cv::Mat ascii_image(image.rows * atlas.cell_height, image.cols * atlas.cell_width, CV_8UC3);
+    profile_count_allocation(ascii_art_str.size());
+    profile_count_allocation(ascii_image.total() * ascii_image.elemSize());
     for (int y = 0; y < image.rows; ++y)
     {
+        const unsigned char *row_indices = &glyph_indices[static_cast<size_t>(y) * image.cols];
+        renderer.kernel(ascii_image, y, atlas, row_indices, image.ptr<cv::Vec3b>(y), image.cols);
+
+        char *line = &ascii_art_str[static_cast<size_t>(y) * line_length];
         for (int x = 0; x < image.cols; ++x)
         {
-            // Get the character at the current position
-            std::string text(1, ascii_art[y * image.cols + x]);
-            int pos_x = x * CHARACTER_WIDTH;
-            int pox_y = y * CHARACTER_HEIGHT + CHARACTER_HEIGHT;
-            cv::Scalar color = colored_flag ? image.at<cv::Vec3b>(y, x) : cv::Scalar::all(255);
-            cv::putText(ascii_image, text, cv::Point(pos_x, pox_y), cv::FONT_HERSHEY_SIMPLEX, 0.5, color, 1);
+            line[x] = atlas.characters[row_indices[x]];
         }
     }
 
-    return std::make_pair(ascii_art_str, ascii_image);
+    return std::make_pair(std::move(ascii_art_str), ascii_image);
 }
\ No newline at end of file
@@ -3,6 +3,36 @@
 
 #include <string>
 
+#include "ansi.hpp"
+#include "glyph_atlas.hpp"
+#include "raster_writer.hpp"
+#include "luminance.hpp"
+#include "thread_pool.hpp"
+#include "converter.hpp"
+
+class ResultCache;
+
+// Settings of the command line run around the converter shared by every image it converts
+struct RunContext
+{
+    bool resize_flag = false;
+    int desired_width = 0;
+    bool print_flag = false;
+    bool stream_flag = false;
+    // also write the glyph and color of every cell to outputs/<name>.grid
+    bool grid_flag = false;
+    // color escapes of the printed text; ANSI_NONE prints plain text
+    AnsiMode ansi_mode = ANSI_NONE;
+    // format and PNG level of outputs/<name>[_color].<png|ppm|qoi>
+    RasterOptions raster;
+    std::string command_line;
+    const Converter *converter = nullptr;
+    // outputs of earlier runs, or null without --cache
+    ResultCache *cache = nullptr;
+    // host threads; with CUDA they only run the --area downsample
+    ThreadPool *pool = nullptr;
+};
+
 // map each rank to a GPU
 #ifdef USE_GPU
 void map_rank_to_gpu(int my_rank);
@@ -11,17 +41,17 @@ void map_rank_to_gpu(int my_rank);
 // load the image from the input file path
 cv::Mat load_image(const std::string &input_filepath);
 
-// resize the image to the desired width and height
-void resize_image(cv::Mat &image, int &desired_width, int &desired_height);
+// resize the image to one pixel per cell of the grid
+void resize_image(cv::Mat &image, cv::Size grid);
 
 // Split the image into equal parts for each rank
 cv::Mat split_image(const cv::Mat &full_image, int my_rank, int num_ranks);
 
 // process the image to get the ASCII art string and the ASCII image
 #ifdef USE_GPU
-std::pair<std::string, cv::Mat> process_image(const cv::Mat &image, bool colored_flag, int threads_x, int threads_y);
+std::pair<std::string, cv::Mat> process_image(const cv::Mat &image, const LuminanceLut &lut, const GlyphAtlas &atlas, const GlyphRenderer &renderer, int threads_x, int threads_y);
 #else
-std::pair<std::string, cv::Mat> process_image(const cv::Mat &image, bool colored_flag);
+std::pair<std::string, cv::Mat> process_image(const cv::Mat &image, const LuminanceLut &lut, const GlyphAtlas &atlas, const GlyphRenderer &renderer, ThreadPool &pool);
 #endif // USE_GPU
 
 #endif // __IMAGE_PROCESSING_HPP__
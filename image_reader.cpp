@@ -0,0 +1,209 @@
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <sys/types.h>
+#include <png.h>
+
+#include "image_reader.hpp"
+
+RowReader::~RowReader()
+{
+    close();
+}
+
+bool RowReader::open(const std::string &filepath)
+{
+    close();
+
+    file = std::fopen(filepath.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    unsigned char signature[8] = {0};
+    size_t got = std::fread(signature, 1, sizeof(signature), file);
+    std::rewind(file);
+
+    bool opened = false;
+    if (got == sizeof(signature) && png_sig_cmp(signature, 0, sizeof(signature)) == 0)
+    {
+        opened = open_png();
+    }
+    else if (got >= 2 && signature[0] == 'P' && signature[1] == '6')
+    {
+        opened = open_ppm();
+    }
+
+    if (!opened)
+    {
+        close();
+    }
+    return opened;
+}
+
+void RowReader::close()
+{
+    if (png != nullptr)
+    {
+        png_structp png_ptr = static_cast<png_structp>(png);
+        png_infop info_ptr = static_cast<png_infop>(png_info);
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        png = nullptr;
+        png_info = nullptr;
+    }
+    if (file != nullptr)
+    {
+        std::fclose(file);
+        file = nullptr;
+    }
+    width = height = next_row = 0;
+    ppm_data_offset = -1;
+    skip_row.clear();
+}
+
+// set up libpng to hand out 8-bit BGR rows whatever the bit depth, palette or alpha of the file
+bool RowReader::open_png()
+{
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info_ptr = png_ptr ? png_create_info_struct(png_ptr) : nullptr;
+    png = png_ptr;
+    png_info = info_ptr;
+    if (info_ptr == nullptr)
+    {
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        return false;
+    }
+
+    png_init_io(png_ptr, file);
+    png_read_info(png_ptr, info_ptr);
+
+    // interlaced rows are only complete after the last pass, so they cannot be streamed
+    if (png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE)
+    {
+        return false;
+    }
+
+    png_set_expand(png_ptr);
+    png_set_strip_16(png_ptr);
+    png_set_strip_alpha(png_ptr);
+    png_set_gray_to_rgb(png_ptr);
+    png_set_bgr(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    width = png_get_image_width(png_ptr, info_ptr);
+    height = png_get_image_height(png_ptr, info_ptr);
+    next_row = 0;
+    return png_get_rowbytes(png_ptr, info_ptr) == static_cast<size_t>(width) * 3;
+}
+
+// skip whitespace and # comments in a PPM header
+static int next_header_char(FILE *file)
+{
+    int c = std::fgetc(file);
+    while (c == '#' || std::isspace(c))
+    {
+        if (c == '#')
+        {
+            while (c != '\n' && c != EOF)
+            {
+                c = std::fgetc(file);
+            }
+        }
+        c = std::fgetc(file);
+    }
+    return c;
+}
+
+static long read_header_number(FILE *file)
+{
+    int c = next_header_char(file);
+    long value = -1;
+    while (c != EOF && std::isdigit(c))
+    {
+        value = (value < 0 ? 0 : value * 10) + (c - '0');
+        c = std::fgetc(file);
+    }
+    return value;
+}
+
+// read the PPM header; the pixels follow the single whitespace after maxval
+bool RowReader::open_ppm()
+{
+    std::fseek(file, 2, SEEK_SET);
+    long header_width = read_header_number(file);
+    long header_height = read_header_number(file);
+    long maxval = read_header_number(file);
+    if (header_width <= 0 || header_height <= 0 || header_width > INT_MAX / 3 || header_height > INT_MAX || maxval != 255)
+    {
+        return false;
+    }
+
+    width = static_cast<int>(header_width);
+    height = static_cast<int>(header_height);
+    ppm_data_offset = std::ftell(file);
+    return true;
+}
+
+void RowReader::read_rows(int start_row, int end_row, cv::Mat &band)
+{
+    if (!is_open() || start_row < 0 || end_row > height || start_row > end_row)
+    {
+        throw std::runtime_error("Invalid row range for the streamed image");
+    }
+
+    band.create(end_row - start_row, width, CV_8UC3);
+    const size_t row_bytes = static_cast<size_t>(width) * 3;
+
+    if (is_seekable())
+    {
+        off_t offset = static_cast<off_t>(ppm_data_offset) + static_cast<off_t>(start_row) * row_bytes;
+        if (fseeko(file, offset, SEEK_SET) != 0)
+        {
+            throw std::runtime_error("Could not seek in the streamed image");
+        }
+        for (int i = 0; i < band.rows; ++i)
+        {
+            unsigned char *row = band.ptr<unsigned char>(i);
+            if (std::fread(row, 1, row_bytes, file) != row_bytes)
+            {
+                throw std::runtime_error("The streamed image is truncated");
+            }
+            // PPM is RGB
+            for (size_t x = 0; x < row_bytes; x += 3)
+            {
+                std::swap(row[x], row[x + 2]);
+            }
+        }
+        return;
+    }
+
+    if (start_row < next_row)
+    {
+        throw std::runtime_error("PNG rows can only be read forwards");
+    }
+
+    png_structp png_ptr = static_cast<png_structp>(png);
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        throw std::runtime_error("Could not decode the streamed image");
+    }
+
+    skip_row.resize(row_bytes);
+    while (next_row < start_row)
+    {
+        png_read_row(png_ptr, skip_row.data(), nullptr);
+        ++next_row;
+    }
+    for (int i = 0; i < band.rows; ++i)
+    {
+        png_read_row(png_ptr, band.ptr<unsigned char>(i), nullptr);
+        ++next_row;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef __IMAGE_READER_HPP__
+#define __IMAGE_READER_HPP__
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Reads an image from the top down, one band of rows at a time, so only the current band is ever in memory.
+// Non-interlaced PNGs are decoded row by row with libpng and can only be read forwards.
+// Binary PPMs (P6, 8 bits) are read straight from the file, so any rank can open the file and seek to its own rows.
+// Rows come out as 8-bit BGR, the same pixels cv::imread(IMREAD_COLOR) gives for these files.
+class RowReader
+{
+public:
+    RowReader() = default;
+    ~RowReader();
+
+    RowReader(const RowReader &) = delete;
+    RowReader &operator=(const RowReader &) = delete;
+
+    // returns false, leaving the reader closed, if the file is missing or not in a format that can be streamed
+    bool open(const std::string &filepath);
+    void close();
+
+    bool is_open() const { return file != nullptr; }
+    bool is_seekable() const { return ppm_data_offset >= 0; }
+    int rows() const { return height; }
+    int cols() const { return width; }
+
+    // read rows [start_row, end_row) into band (CV_8UC3). Unless the reader is seekable,
+    // start_row must not be before the end of the previous read; rows in between are skipped.
+    void read_rows(int start_row, int end_row, cv::Mat &band);
+
+private:
+    bool open_png();
+    bool open_ppm();
+
+    FILE *file = nullptr;
+    int width = 0;
+    int height = 0;
+
+    // PNG state; next_row is the first row libpng has not returned yet
+    void *png = nullptr;
+    void *png_info = nullptr;
+    int next_row = 0;
+    std::vector<unsigned char> skip_row;
+
+    // byte offset of the first pixel of a PPM, -1 for PNG
+    long ppm_data_offset = -1;
+};
+
+#endif // __IMAGE_READER_HPP__
@@ -0,0 +1,183 @@
+#include "luminance.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LUMINANCE_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LUMINANCE_NEON
+#endif
+
+// Reference kernel, also used for the tail of every vectorized row
+static void gray_row_scalar(const uint8_t *bgr, int cols, const uint16_t *weights, uint8_t *gray)
+{
+    for (int x = 0; x < cols; ++x)
+    {
+        const uint8_t *p = bgr + 3 * x;
+        gray[x] = static_cast<uint8_t>((weights[0] * p[0] + weights[1] * p[1] + weights[2] * p[2]) >> 8);
+    }
+}
+
+#ifdef LUMINANCE_X86
+// Split 16 interleaved BGR pixels (48 bytes) into one register per channel
+__attribute__((target("sse4.1"))) static inline void deinterleave_bgr16(const uint8_t *p, __m128i &b, __m128i &g, __m128i &r)
+{
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32));
+
+    b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                                  _mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+                     _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                                  _mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+                     _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                                  _mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+                     _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+__attribute__((target("sse4.1"))) static void gray_row_sse41(const uint8_t *bgr, int cols, const uint16_t *weights, uint8_t *gray)
+{
+    const __m128i wb = _mm_set1_epi16(weights[0]);
+    const __m128i wg = _mm_set1_epi16(weights[1]);
+    const __m128i wr = _mm_set1_epi16(weights[2]);
+    const __m128i zero = _mm_setzero_si128();
+
+    int x = 0;
+    for (; x + 16 <= cols; x += 16)
+    {
+        __m128i b, g, r;
+        deinterleave_bgr16(bgr + 3 * x, b, g, r);
+
+        __m128i lo = _mm_mullo_epi16(_mm_cvtepu8_epi16(b), wb);
+        lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_cvtepu8_epi16(g), wg));
+        lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_cvtepu8_epi16(r), wr));
+
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wb);
+        hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), wg));
+        hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), wr));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gray + x), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+
+    gray_row_scalar(bgr + 3 * x, cols - x, weights, gray + x);
+}
+
+__attribute__((target("avx2"))) static void gray_row_avx2(const uint8_t *bgr, int cols, const uint16_t *weights, uint8_t *gray)
+{
+    const __m256i wb = _mm256_set1_epi16(weights[0]);
+    const __m256i wg = _mm256_set1_epi16(weights[1]);
+    const __m256i wr = _mm256_set1_epi16(weights[2]);
+
+    int x = 0;
+    for (; x + 16 <= cols; x += 16)
+    {
+        __m128i b, g, r;
+        deinterleave_bgr16(bgr + 3 * x, b, g, r);
+
+        // widen all 16 pixels at once and do the multiply-adds in a single 256-bit register
+        __m256i sum = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(b), wb);
+        sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(g), wg));
+        sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(r), wr));
+        sum = _mm256_srli_epi16(sum, 8);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gray + x), _mm_packus_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+    }
+
+    gray_row_scalar(bgr + 3 * x, cols - x, weights, gray + x);
+}
+#endif // LUMINANCE_X86
+
+#ifdef LUMINANCE_NEON
+static void gray_row_neon(const uint8_t *bgr, int cols, const uint16_t *weights, uint8_t *gray)
+{
+    const uint8x8_t wb = vdup_n_u8(static_cast<uint8_t>(weights[0]));
+    const uint8x8_t wg = vdup_n_u8(static_cast<uint8_t>(weights[1]));
+    const uint8x8_t wr = vdup_n_u8(static_cast<uint8_t>(weights[2]));
+
+    int x = 0;
+    for (; x + 16 <= cols; x += 16)
+    {
+        uint8x16x3_t px = vld3q_u8(bgr + 3 * x);
+
+        uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), wb);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[1]), wg);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[2]), wr);
+
+        uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), wb);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[1]), wg);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[2]), wr);
+
+        vst1q_u8(gray + x, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+
+    gray_row_scalar(bgr + 3 * x, cols - x, weights, gray + x);
+}
+#endif // LUMINANCE_NEON
+
+// pick the widest kernel the CPU supports
+static void select_kernel(LuminanceLut &lut)
+{
+#if defined(LUMINANCE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        lut.kernel = gray_row_avx2;
+        lut.kernel_name = "avx2";
+        return;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        lut.kernel = gray_row_sse41;
+        lut.kernel_name = "sse4.1";
+        return;
+    }
+#elif defined(LUMINANCE_NEON)
+    lut.kernel = gray_row_neon;
+    lut.kernel_name = "neon";
+    return;
+#endif
+    lut.kernel = gray_row_scalar;
+    lut.kernel_name = "scalar";
+}
+
+// Build the gray-to-glyph table. 0.299/0.587/0.114 become 77/150/29 out of 256.
+LuminanceLut build_luminance_lut(int num_chars, bool rec601_flag)
+{
+    LuminanceLut lut;
+
+    if (rec601_flag)
+    {
+        // OpenCV pixels are BGR, so the 0.299 red weight belongs on the last byte
+        lut.weights[0] = 29;
+        lut.weights[1] = 150;
+        lut.weights[2] = 77;
+    }
+    else
+    {
+        lut.weights[0] = 77;
+        lut.weights[1] = 150;
+        lut.weights[2] = 29;
+    }
+
+    for (int gray = 0; gray < 256; ++gray)
+    {
+        lut.glyph_index[gray] = static_cast<uint8_t>(gray * (num_chars - 1) / 255);
+    }
+
+    select_kernel(lut);
+
+    return lut;
+}
+
+// convert a row to gray levels with the SIMD kernel, then map each level through the table in place
+void row_to_glyph_indices(const cv::Vec3b *row, int cols, const LuminanceLut &lut, uint8_t *indices)
+{
+    lut.kernel(reinterpret_cast<const uint8_t *>(row), cols, lut.weights, indices);
+
+    for (int x = 0; x < cols; ++x)
+    {
+        indices[x] = lut.glyph_index[indices[x]];
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef __LUMINANCE_HPP__
+#define __LUMINANCE_HPP__
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+// converts a row of BGR pixels to 8-bit gray levels using the given fixed-point weights
+typedef void (*GrayRowKernel)(const uint8_t *bgr, int cols, const uint16_t *weights, uint8_t *gray);
+
+// Everything needed to turn pixels into glyph indices, built once per run
+struct LuminanceLut
+{
+    // fixed-point weights applied to the B, G and R bytes of a pixel, summing to 256
+    uint16_t weights[3];
+    // glyph index for every gray level
+    uint8_t glyph_index[256];
+    // fastest row kernel supported by the CPU we are running on
+    GrayRowKernel kernel;
+    const char *kernel_name;
+};
+
+// build the gray-to-glyph table for a charset of num_chars characters.
+// rec601_flag applies the Rec.601 weights to R, G, B; otherwise the legacy order (0.299 on B) is kept
+LuminanceLut build_luminance_lut(int num_chars, bool rec601_flag);
+
+// convert one row of cols pixels to glyph indices
+void row_to_glyph_indices(const cv::Vec3b *row, int cols, const LuminanceLut &lut, uint8_t *indices);
+
+#endif // __LUMINANCE_HPP__
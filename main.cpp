@@ -1,195 +1,959 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <deque>
+#include <map>
 #include <string>
 #include <vector>
 #include <memory>
-#include <mpi.h>
+#include <sys/resource.h>
 #include <opencv2/opencv.hpp>
 
 #include "utils.hpp"
+#include "ansi.hpp"
 #include "constants.hpp"
 #include "image_processing.hpp"
+#include "converter.hpp"
+#include "daemon.hpp"
+#include "result_cache.hpp"
+#include "glyph_atlas.hpp"
+#include "raster_writer.hpp"
+#include "grid_file.hpp"
+#include "video.hpp"
+#include "downsample.hpp"
+#include "image_reader.hpp"
+#include "profiler.hpp"
+#include "comm.hpp"
 
 using namespace constants;
 
+// Message tags of the batch work queue
+enum BatchTag
+{
+    TAG_REQUEST = 1,
+    TAG_TASK = 2
+};
+
+// What a worker reports back with its next request
+enum BatchStatus
+{
+    BATCH_READY = 0,
+    BATCH_DONE = 1,
+    BATCH_DEFERRED = 2,
+    BATCH_FAILED = 3
+};
+
+// Writes out the text and the PNG of one image while its rows are still being converted. Every rank hands
+// over the text of the cell rows it converted, which goes straight to its place in the text file with a
+// nonblocking write, and the ASCII image of every PNG chunk it holds, which is deflated at once. Only the
+// PNG waits for every rank, since its chunk offsets depend on how well the others compress. With --grid
+// the glyphs and colors of the cells go to their fixed offsets in the .grid file the same way, and with
+// --ansi each piece of text is encoded for printing by the rank that converted it. Constructing and
+// finishing are collective over comm.
+class ImageWriter
+{
+public:
+    ImageWriter(const std::string &output_filepath, int desired_width, int desired_height, cv::Size grid, int num_png_chunks, const RunContext &context, Comm comm);
+
+    // whether add_text needs the color of every cell
+    bool wants_cell_colors() const;
+
+    // the text of the cell rows starting at first_cell, and their colors (one pixel per cell) if wants_cell_colors
+    void add_text(int first_cell, std::string text, const cv::Mat &cell_colors);
+
+    // the ASCII image of one image chunk
+    void add_image(int chunk, const cv::Mat &image);
+
+    // write the image, wait for the text and grid writes and print the text if asked
+    void finish();
+
+private:
+    const RunContext &context;
+    Comm comm;
+    std::string output_filepath;
+    // every rank builds the same header, so each knows where the art starts
+    std::string header;
+    long long line_length;
+    int grid_rows;
+    // first cell row and text of every piece, kept until the writes complete; a deque never moves them
+    std::deque<std::pair<int, std::string>> texts;
+    std::deque<std::pair<int, std::string>> ansi_texts;
+    ParallelFile text_file;
+    RasterChunkWriter png;
+
+    // the .grid file with --grid, its header, and the glyph and color planes of every piece until the writes complete
+    std::unique_ptr<ParallelFile> grid_file;
+    std::string grid_header;
+    std::deque<std::vector<uint8_t>> grid_planes;
+    // glyph index of every character of the text
+    uint8_t glyph_of[256];
+};
+
 // ------------------ Function Prototypes ------------------
-void broadcast_config(std::string &input_filepath, std::string &output_filepath, bool &resize_flag, int &desired_width, bool &print_flag, bool &negate_flag, bool &colored_flag, bool &help_flag, int rank, std::string &CHARACTERS, int &threads_x, int &threads_y);
-void broadcast_image(cv::Mat &image, int my_rank, MPI_Comm comm);
-void gather_and_print_to_console(const std::string &processed_string, int num_ranks, int my_rank, bool print_flag, bool colored_flag, const std::string &output_filepath);
-void gather_and_save_ascii_art(cv::Mat &ascii_image, int rank, int size, const std::string &output_filepath, bool colored_flag);
-void write_ascii_art_to_file(const std::string &ascii_art, const std::string &output_filepath_txt, MPI_Comm comm, int my_rank, MPI_Offset initial_offset);
+void broadcast_config(std::string &input_filepath, std::string &output_filepath, bool &resize_flag, int &desired_width, bool &print_flag, bool &negate_flag, bool &colored_flag, bool &rec601_flag, bool &area_flag, bool &shape_flag, bool &help_flag, int rank, std::string &characters, float &scale_factor, int &thread_count, bool &batch_flag, bool &video_flag, bool &daemon_flag, bool &stream_flag, bool &profile_flag, bool &grid_flag, AnsiMode &ansi_mode, RasterOptions &raster, std::string &cache_dir, long long &cache_bytes);
+void broadcast_file_list(std::vector<std::string> &files, int rank);
+std::string image_output_path(const std::string &output_filepath, const RunContext &context);
+void print_saved_message(const std::string &output_filepath, const std::string &image_filepath);
+void gather_and_print_to_console(const std::deque<std::pair<int, std::string>> &texts, Comm comm, bool print_flag, const std::string &output_filepath, const std::string &image_filepath);
+cv::Mat prepare_image(const std::string &input_filepath, const RunContext &context, int &desired_width, int &desired_height);
+void convert_image(cv::Mat &input_image, const std::string &output_filepath, int desired_width, int desired_height, const RunContext &context, Comm comm);
+bool convert_image_streaming(const std::string &input_filepath, const std::string &output_filepath, const RunContext &context, Comm comm);
+std::string get_cache_key(const std::string &input_filepath, const RunContext &context);
+bool write_cached_outputs(const std::string &cache_key, const std::string &output_filepath, const RunContext &context);
+void store_cached_outputs(const std::string &cache_key, const std::string &output_filepath, const RunContext &context);
+void convert_file(const std::string &input_filepath, const std::string &output_filepath, const RunContext &context, bool check_cache, Comm comm);
+void report_peak_rss(Comm comm);
+void run_batch(const std::vector<std::string> &files, const RunContext &context, int my_rank, int num_ranks);
 // ---------------------------------------------------------
 
-// broadcast the configuration to all ranks
-void broadcast_config(std::string &input_filepath, std::string &output_filepath, bool &resize_flag, int &desired_width, bool &print_flag, bool &negate_flag, bool &colored_flag, bool &help_flag, int rank, std::string &CHARACTERS, int &threads_x, int &threads_y)
+// Broadcast the configuration to all ranks in two messages, every scalar along with the lengths of the
+// strings, then the strings back to back, since each broadcast costs a full round of latency
+void broadcast_config(std::string &input_filepath, std::string &output_filepath, bool &resize_flag, int &desired_width, bool &print_flag, bool &negate_flag, bool &colored_flag, bool &rec601_flag, bool &area_flag, bool &shape_flag, bool &help_flag, int rank, std::string &characters, float &scale_factor, int &thread_count, bool &batch_flag, bool &video_flag, bool &daemon_flag, bool &stream_flag, bool &profile_flag, bool &grid_flag, AnsiMode &ansi_mode, RasterOptions &raster, std::string &cache_dir, long long &cache_bytes)
 {
-    int chars_length = CHARACTERS.size();
-    MPI_Bcast(&chars_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    ScopedPhase phase(PHASE_BROADCAST);
+    std::string *strings[4] = {&characters, &input_filepath, &output_filepath, &cache_dir};
 
+    struct
+    {
+        bool resize_flag, print_flag, negate_flag, colored_flag, rec601_flag, area_flag, shape_flag, help_flag;
+        bool batch_flag, video_flag, daemon_flag, stream_flag, profile_flag, grid_flag;
+        int desired_width, thread_count, ansi_mode, raster_format, png_level;
+        float scale_factor;
+        long long cache_bytes;
+        unsigned long long lengths[4];
+    } config;
+    config.resize_flag = resize_flag;
+    config.print_flag = print_flag;
+    config.negate_flag = negate_flag;
+    config.colored_flag = colored_flag;
+    config.rec601_flag = rec601_flag;
+    config.area_flag = area_flag;
+    config.shape_flag = shape_flag;
+    config.help_flag = help_flag;
+    config.batch_flag = batch_flag;
+    config.video_flag = video_flag;
+    config.daemon_flag = daemon_flag;
+    config.stream_flag = stream_flag;
+    config.profile_flag = profile_flag;
+    config.grid_flag = grid_flag;
+    config.desired_width = desired_width;
+    config.thread_count = thread_count;
+    config.ansi_mode = ansi_mode;
+    config.raster_format = raster.format;
+    config.png_level = raster.png_level;
+    config.scale_factor = scale_factor;
+    config.cache_bytes = cache_bytes;
+    std::string joined;
+    for (int i = 0; i < 4; ++i)
+    {
+        config.lengths[i] = strings[i]->size();
+        joined += *strings[i];
+    }
+
+    broadcast_value(config, COMM_WORLD);
+
+    resize_flag = config.resize_flag;
+    print_flag = config.print_flag;
+    negate_flag = config.negate_flag;
+    colored_flag = config.colored_flag;
+    rec601_flag = config.rec601_flag;
+    area_flag = config.area_flag;
+    shape_flag = config.shape_flag;
+    help_flag = config.help_flag;
+    batch_flag = config.batch_flag;
+    video_flag = config.video_flag;
+    daemon_flag = config.daemon_flag;
+    stream_flag = config.stream_flag;
+    profile_flag = config.profile_flag;
+    grid_flag = config.grid_flag;
+    desired_width = config.desired_width;
+    thread_count = config.thread_count;
+    ansi_mode = static_cast<AnsiMode>(config.ansi_mode);
+    raster.format = static_cast<RasterFormat>(config.raster_format);
+    raster.png_level = config.png_level;
+    scale_factor = config.scale_factor;
+    cache_bytes = config.cache_bytes;
+
+    joined.resize(config.lengths[0] + config.lengths[1] + config.lengths[2] + config.lengths[3]);
+    broadcast_bytes(&joined[0], joined.size(), COMM_WORLD);
     if (rank != 0)
     {
-        CHARACTERS.resize(chars_length);
+        size_t start = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            strings[i]->assign(joined, start, config.lengths[i]);
+            start += config.lengths[i];
+        }
     }
+}
 
-    MPI_Bcast(&CHARACTERS[0], chars_length, MPI_CHAR, 0, MPI_COMM_WORLD);
+// broadcast the list of input images of a batch run as one newline-separated string
+void broadcast_file_list(std::vector<std::string> &files, int rank)
+{
+    ScopedPhase phase(PHASE_BROADCAST);
+    std::string joined;
+    if (rank == 0)
+    {
+        for (const std::string &file : files)
+        {
+            joined += file + "\n";
+        }
+    }
 
-    int input_path_length = input_filepath.size();
-    MPI_Bcast(&input_path_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    broadcast_string(joined, COMM_WORLD);
 
     if (rank != 0)
     {
-        input_filepath.resize(input_path_length);
+        files.clear();
+        size_t start = 0, end;
+        while ((end = joined.find('\n', start)) != std::string::npos)
+        {
+            files.push_back(joined.substr(start, end - start));
+            start = end + 1;
+        }
     }
+}
 
-    MPI_Bcast(&input_filepath[0], input_path_length, MPI_CHAR, 0, MPI_COMM_WORLD);
+// where the rendered image of output_filepath goes: outputs/<name>[_color] with the extension of its format
+std::string image_output_path(const std::string &output_filepath, const RunContext &context)
+{
+    std::string color_output_string = (context.converter->config().colored_flag) ? "_color" : "";
+    return "outputs/" + output_filepath + color_output_string + raster_extension(context.raster.format);
+}
 
-    int output_path_length = output_filepath.size();
-    MPI_Bcast(&output_path_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+// tell where the ASCII art went
+void print_saved_message(const std::string &output_filepath, const std::string &image_filepath)
+{
+    std::cout << "\nASCII art saved to outputs/" << output_filepath << ".txt and " << image_filepath << "\n";
+    std::cout.flush();
+}
 
-    if (rank != 0)
+// print the ASCII art in order to the console. Nothing is gathered unless it is printed, and
+// rank 0 prints its own rows straight from their text, so only the rows of the other ranks are copied.
+void gather_and_print_to_console(const std::deque<std::pair<int, std::string>> &texts, Comm comm, bool print_flag, const std::string &output_filepath, const std::string &image_filepath)
+{
+    if (!print_flag)
     {
-        output_filepath.resize(output_path_length);
+        return;
     }
 
-    MPI_Bcast(&output_filepath[0], output_path_length, MPI_CHAR, 0, MPI_COMM_WORLD);
+    ScopedPhase phase(PHASE_GATHER);
+    int my_rank = comm_rank(comm);
 
-    // Broadcast other configuration parameters
-    MPI_Bcast(&resize_flag, 1, MPI_C_BOOL, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&desired_width, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&print_flag, 1, MPI_C_BOOL, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&negate_flag, 1, MPI_C_BOOL, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&colored_flag, 1, MPI_C_BOOL, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&help_flag, 1, MPI_C_BOOL, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&threads_x, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&threads_y, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    // Every other rank sends its pieces back to back, with the first cell row and size of each; rank 0 keeps its own
+    std::vector<long long> pieces;
+    std::string joined;
+    const char *local_data = nullptr;
+    size_t local_size = 0;
+    if (my_rank != 0)
+    {
+        for (const std::pair<int, std::string> &text : texts)
+        {
+            pieces.push_back(text.first);
+            pieces.push_back(text.second.size());
+            local_size += text.second.size();
+        }
+        if (texts.size() == 1)
+        {
+            local_data = texts.front().second.data();
+        }
+        else
+        {
+            for (const std::pair<int, std::string> &text : texts)
+            {
+                joined += text.second;
+            }
+            profile_count_copy(joined.size());
+            local_data = joined.data();
+        }
+    }
+
+    // Buffers to gather the strings of the other ranks and where they go
+    std::vector<char> full_output;
+    std::vector<char> gathered_pieces;
+
+    // Gather all strings to rank 0
+    gather_bytes(reinterpret_cast<const char *>(pieces.data()), pieces.size() * sizeof(long long), gathered_pieces, comm);
+    gather_bytes(local_data, local_size, full_output, comm);
+    if (my_rank != 0)
+    {
+        return;
+    }
+    profile_count_allocation(full_output.size());
+    profile_count_copy(full_output.size());
+
+    // every piece by its first cell row: rank 0's own, then the gathered ones, which follow each other in full_output
+    std::map<int, std::pair<const char *, size_t>> ordered;
+    for (const std::pair<int, std::string> &text : texts)
+    {
+        ordered[text.first] = std::make_pair(text.second.data(), text.second.size());
+    }
+    std::vector<long long> other_pieces(gathered_pieces.size() / sizeof(long long));
+    std::memcpy(other_pieces.data(), gathered_pieces.data(), other_pieces.size() * sizeof(long long));
+    const char *data = full_output.data();
+    for (size_t i = 0; i < other_pieces.size(); i += 2)
+    {
+        ordered[static_cast<int>(other_pieces[i])] = std::make_pair(data, static_cast<size_t>(other_pieces[i + 1]));
+        data += other_pieces[i + 1];
+    }
+
+    // Print the ASCII art in order to the console
+    std::cout << "\n";
+    for (const auto &piece : ordered)
+    {
+        std::cout.write(piece.second.first, piece.second.second);
+    }
+    print_saved_message(output_filepath, image_filepath);
 }
 
-// broadcast the image dimensions and type to all ranks
-void broadcast_image(cv::Mat &image, int my_rank, MPI_Comm comm)
+ImageWriter::ImageWriter(const std::string &output_filepath, int desired_width, int desired_height, cv::Size grid, int num_png_chunks, const RunContext &context, Comm comm)
+    : context(context), comm(comm), output_filepath(output_filepath), line_length(grid.width + 1), grid_rows(grid.height),
+      text_file("outputs/" + output_filepath + ".txt", comm), png(num_png_chunks, context.raster, *context.pool)
 {
-    int dims[3] = {image.rows, image.cols, image.type()};
-    MPI_Bcast(dims, 3, MPI_INT, 0, comm);
+    header += context.command_line;
+    header += "\n";
+    header += "Dimensions: " + std::to_string(desired_width) + "x" + std::to_string(desired_height) + "\n\n";
 
-    if (my_rank != 0)
+    if (comm_rank(comm) == 0)
     {
-        image.create(dims[0], dims[1], dims[2]);
+        ScopedPhase phase(PHASE_WRITE);
+        text_file.iwrite_at(0, header.data(), header.size());
     }
 
-    MPI_Bcast(image.data, image.total() * image.elemSize(), MPI_BYTE, 0, comm);
+    if (context.grid_flag)
+    {
+        ScopedPhase phase(PHASE_WRITE);
+        const ConverterConfig &config = context.converter->config();
+        const GlyphAtlas &atlas = context.converter->atlas();
+        int flags = (config.colored_flag ? GRID_COLORS : 0) | (config.negate_flag ? GRID_NEGATE : 0) | (config.rec601_flag ? GRID_REC601 : 0) | (config.area_flag ? GRID_AREA : 0) | (config.shape_flag ? GRID_SHAPE : 0);
+        grid_header = grid_file_header(grid.width, grid.height, atlas.cell_width, atlas.cell_height, atlas.characters, flags);
+
+        // the first of a repeated character stands for all of them, as they draw the same glyph
+        for (int i = atlas.num_glyphs - 1; i >= 0; --i)
+        {
+            glyph_of[static_cast<unsigned char>(atlas.characters[i])] = static_cast<uint8_t>(i);
+        }
+
+        // sized up front, since a file left by an earlier run may be longer
+        grid_file.reset(new ParallelFile("outputs/" + output_filepath + ".grid", comm));
+        long long cells = static_cast<long long>(grid.width) * grid.height;
+        grid_file->set_size(grid_header.size() + cells * (config.colored_flag ? 4 : 1));
+        if (comm_rank(comm) == 0)
+        {
+            grid_file->iwrite_at(0, grid_header.data(), grid_header.size());
+        }
+    }
 }
 
-// print the ASCII art in order to the console
-void gather_and_print_to_console(const std::string &processed_string, int num_ranks, int my_rank, bool print_flag, bool colored_flag, const std::string &output_filepath)
+bool ImageWriter::wants_cell_colors() const
 {
-    // Buffer to gather all strings
-    std::vector<char> full_output;
+    return context.ansi_mode != ANSI_NONE || (grid_file && context.converter->config().colored_flag);
+}
+
+void ImageWriter::add_text(int first_cell, std::string text, const cv::Mat &cell_colors)
+{
+    if (text.empty())
+    {
+        return;
+    }
 
-    // Size of each local string
-    int local_size = processed_string.size();
+    if (context.ansi_mode != ANSI_NONE)
+    {
+        ScopedBusy busy;
+        ansi_texts.emplace_back(first_cell, encode_ansi(text.data(), cell_colors, context.ansi_mode, *context.pool));
+    }
+
+    ScopedPhase phase(PHASE_WRITE);
+    if (grid_file)
+    {
+        // the planes of these rows: the glyph indices, then the RGB of every cell with colors
+        const int cols = line_length - 1;
+        const size_t num_rows = text.size() / line_length;
+        const size_t cells = num_rows * cols;
+        const bool colored_flag = context.converter->config().colored_flag;
+        grid_planes.emplace_back(cells * (colored_flag ? 4 : 1));
+        uint8_t *glyphs = grid_planes.back().data();
+        uint8_t *rgb = glyphs + cells;
+        profile_count_allocation(grid_planes.back().size());
+
+        for (size_t i = 0; i < num_rows; ++i)
+        {
+            const char *line = &text[i * line_length];
+            uint8_t *row_glyphs = glyphs + i * cols;
+            for (int j = 0; j < cols; ++j)
+            {
+                row_glyphs[j] = glyph_of[static_cast<unsigned char>(line[j])];
+            }
+            if (colored_flag)
+            {
+                const cv::Vec3b *colors = cell_colors.ptr<cv::Vec3b>(i);
+                uint8_t *row_rgb = rgb + 3 * i * cols;
+                for (int j = 0; j < cols; ++j)
+                {
+                    row_rgb[3 * j] = colors[j][2];
+                    row_rgb[3 * j + 1] = colors[j][1];
+                    row_rgb[3 * j + 2] = colors[j][0];
+                }
+            }
+        }
 
-    // Gather sizes first to prepare buffer on rank 0
-    std::vector<int> sizes(num_ranks, 0);
-    MPI_Gather(&local_size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        grid_file->iwrite_at(grid_glyph_offset(grid_header.size(), cols, first_cell, 0), glyphs, cells);
+        if (colored_flag)
+        {
+            grid_file->iwrite_at(grid_color_offset(grid_header.size(), cols, grid_rows, first_cell, 0), rgb, 3 * cells);
+        }
+    }
 
-    // Displacements for gather
-    std::vector<int> displacements(num_ranks, 0);
+    texts.emplace_back(first_cell, std::move(text));
+    const std::string &piece = texts.back().second;
+    text_file.iwrite_at(header.size() + first_cell * line_length, piece.data(), piece.size());
+}
 
-    if (my_rank == 0)
+void ImageWriter::add_image(int chunk, const cv::Mat &image)
+{
+    ScopedPhase phase(PHASE_PNG);
+    png.add(chunk, image);
+}
+
+void ImageWriter::finish()
+{
+    std::string image_filepath = image_output_path(output_filepath, context);
     {
-        // Compute total size and displacements
-        int total_size = 0;
-        for (int i = 0; i < num_ranks; ++i)
+        ScopedPhase phase(PHASE_PNG);
+        png.write(image_filepath, comm);
+    }
+
+    // the text and grid writes have had the whole image write to complete
+    {
+        ScopedPhase phase(PHASE_WRITE);
+        text_file.close();
+        if (grid_file)
         {
-            displacements[i] = total_size;
-            total_size += sizes[i];
+            grid_file->close();
+            grid_planes.clear();
         }
-        full_output.resize(total_size);
     }
 
-    // Gather all strings to rank 0
-    MPI_Gatherv(processed_string.data(), local_size, MPI_CHAR,
-                full_output.data(), sizes.data(), displacements.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+    // Combine the ASCII art from all ranks and print it to the console
+    gather_and_print_to_console(context.ansi_mode != ANSI_NONE ? ansi_texts : texts, comm, context.print_flag, output_filepath, image_filepath);
+    texts.clear();
+    ansi_texts.clear();
+}
 
-    // Print the ASCII art in order to the console
-    if (my_rank == 0 && print_flag)
+// load an image and resize it to the output grid; returns the resized image.
+// With --area the source is returned as is unless the grid is larger than it, since only
+// downsampling can be fused into the conversion.
+cv::Mat prepare_image(const std::string &input_filepath, const RunContext &context, int &desired_width, int &desired_height)
+{
+    cv::Mat input_image = load_image(input_filepath);
+
+    // Resize the image to the desired width and height
+    if (context.resize_flag)
     {
-        std::cout << "\n";
-        std::cout.write(full_output.data(), full_output.size());
-        std::string color_output_string = (colored_flag) ? "_color" : "";
-        std::cout << "\nASCII art saved to outputs/" << output_filepath << ".txt and outputs/" << output_filepath << color_output_string << ".png\n";
-        std::cout.flush();
+        desired_width = context.desired_width;
+        desired_height = (input_image.rows * desired_width) / input_image.cols;
+    }
+    else
+    {
+        desired_width = input_image.cols;
+        desired_height = input_image.rows;
     }
+
+    cv::Size grid = context.converter->grid_size(desired_width, desired_height);
+    if (!context.converter->config().area_flag || grid.width <= 0 || grid.height <= 0 || grid.width > input_image.cols || grid.height > input_image.rows)
+    {
+        resize_image(input_image, grid);
+    }
+
+    return input_image;
 }
 
-// gather the ASCII art from all ranks and save it to a file
-void gather_and_save_ascii_art(cv::Mat &ascii_image, int rank, int size, const std::string &output_filepath, bool colored_flag)
+// Convert one image with every rank of comm. The image is placed once per node in a RowWindow, and the
+// cell rows are split into CHUNKS_PER_RANK chunks per rank that the ranks claim one at a time from a
+// WorkCounter. Ranks that are slower, or get rows that cost more to render, simply convert fewer chunks.
+// Each converted chunk is handed to the ImageWriter at once, so its writes overlap the next conversion.
+// input_image only needs to be set on rank 0 of comm, and is released once it is in the window.
+void convert_image(cv::Mat &input_image, const std::string &output_filepath, int desired_width, int desired_height, const RunContext &context, Comm comm)
 {
-    // total number of bytes in the ascii_image
-    int send_count = ascii_image.total() * ascii_image.elemSize();
-    std::vector<int> recvcounts(size);
-    std::vector<int> displs(size);
+    int my_rank = comm_rank(comm);
+    int num_ranks = comm_size(comm);
+    const Converter &converter = *context.converter;
 
-    // Gather all sendcounts to calculate total size and displacements
-    MPI_Gather(&send_count, 1, MPI_INT, recvcounts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    // source rows, source cols, type, grid width, grid height, desired width, desired height
+    int dims[7] = {0};
+    if (my_rank == 0)
+    {
+        // With --area the source rows are averaged straight into cells, so the resize is distributed too.
+        // A grid the size of the (already upsampled) image averages single pixels.
+        cv::Size grid = input_image.size();
+        if (converter.config().area_flag)
+        {
+            grid = converter.grid_size(desired_width, desired_height);
+            if (grid.width <= 0 || grid.height <= 0 || grid.width > input_image.cols || grid.height > input_image.rows)
+            {
+                grid = input_image.size();
+            }
+        }
+        dims[0] = input_image.rows;
+        dims[1] = input_image.cols;
+        dims[2] = input_image.type();
+        dims[3] = grid.width;
+        dims[4] = grid.height;
+        dims[5] = desired_width;
+        dims[6] = desired_height;
+    }
+    {
+        ScopedPhase phase(PHASE_DISTRIBUTE);
+        broadcast_value(dims, comm);
+    }
+    const int source_rows = dims[0];
+    const cv::Size grid(dims[3], dims[4]);
+    // an empty grid has no cells to average into, and was resized like one without --area
+    const bool area_flag = converter.config().area_flag && grid.width > 0 && grid.height > 0;
 
-    cv::Mat full_image;
+    // a single rank converts the image in one piece, as its thread pool splits it anyway
+    const int num_chunks = (num_ranks == 1) ? 1 : std::max(1, std::min(grid.height, num_ranks * CHUNKS_PER_RANK));
+    ImageWriter writer(output_filepath, dims[5], dims[6], grid, num_chunks, context, comm);
 
-    if (rank == 0)
+    // every rank of a node reads the rows of its chunks in place from the node's copy of the image
+    RowWindow source(input_image, dims[0], dims[1], dims[2], comm);
+    input_image.release();
+    WorkCounter counter(comm);
+
+    for (int chunk = counter.next(); chunk < num_chunks; chunk = counter.next())
+    {
+        std::pair<int, int> cells = get_row_range(grid.height, chunk, num_chunks);
+        std::pair<int, int> range = area_flag ? get_source_row_range(source_rows, grid.height, cells.first, cells.second) : cells;
+        cv::Mat rows = source.row_range(range.first, range.second);
+
+        std::pair<std::string, cv::Mat> output;
+        // without --area the rows are already one pixel per cell
+        cv::Mat cell_colors = rows;
+        {
+            ScopedBusy busy;
+            if (area_flag)
+            {
+                // both outputs are sized exactly once and filled in place
+                output.first.assign(static_cast<size_t>(cells.second - cells.first) * (grid.width + 1), '\n');
+                output.second.create(converter.atlas().cell_height * (cells.second - cells.first), converter.atlas().cell_width * grid.width, CV_8UC3);
+                profile_count_allocation(output.first.size());
+                profile_count_allocation(output.second.total() * output.second.elemSize());
+
+                cell_colors = cv::Mat();
+                if (writer.wants_cell_colors())
+                {
+                    cell_colors.create(cells.second - cells.first, grid.width, CV_8UC3);
+                }
+                converter.convert_area(rows, source_rows, cells.first, cells.second, grid, *context.pool, &output.first[0], output.second, cell_colors.empty() ? nullptr : &cell_colors);
+            }
+            else
+            {
+                // Process the rows to get the ASCII art string and the ASCII image
+                output = converter.convert_rows(rows, *context.pool);
+            }
+        }
+        writer.add_text(cells.first, std::move(output.first), cell_colors);
+        writer.add_image(chunk, output.second);
+        profile_count_chunk();
+    }
+
+    counter.close();
+    source.close();
+
+    writer.finish();
+}
+
+// Convert one image without any rank ever holding all of it. Source rows are decoded in bands of about
+// STREAM_BAND_ROWS rows and averaged straight into cells, as with --area. A seekable file (PPM) is read by
+// every rank directly; otherwise rank 0 decodes it top to bottom and sends each band to the rank that owns it.
+// Returns false on every rank, having converted nothing, if the file cannot be streamed or the grid is
+// larger than the image.
+bool convert_image_streaming(const std::string &input_filepath, const std::string &output_filepath, const RunContext &context, Comm comm)
+{
+    int my_rank = comm_rank(comm);
+    int num_ranks = comm_size(comm);
+    const Converter &converter = *context.converter;
+
+    // streamable, seekable, source rows, source cols, desired width, desired height, grid width, grid height
+    int info[8] = {0};
+    RowReader reader;
+    if (my_rank == 0 && reader.open(input_filepath))
     {
-        int total_size = 0;
-        for (int i = 0; i < size; ++i)
+        int desired_width = context.resize_flag ? context.desired_width : reader.cols();
+        int desired_height = context.resize_flag ? static_cast<int>(static_cast<long long>(reader.rows()) * desired_width / reader.cols()) : reader.rows();
+        cv::Size grid = converter.grid_size(desired_width, desired_height);
+
+        info[0] = grid.width > 0 && grid.height > 0 && grid.width <= reader.cols() && grid.height <= reader.rows();
+        info[1] = reader.is_seekable();
+        info[2] = reader.rows();
+        info[3] = reader.cols();
+        info[4] = desired_width;
+        info[5] = desired_height;
+        info[6] = grid.width;
+        info[7] = grid.height;
+    }
+    broadcast_value(info, comm);
+
+    if (!info[0])
+    {
+        if (my_rank == 0)
         {
-            displs[i] = total_size;
-            total_size += recvcounts[i];
+            std::cerr << "Note: " << input_filepath << " cannot be streamed (only non-interlaced PNG and 8-bit PPM that are downsampled), loading it whole.\n";
         }
+        return false;
+    }
 
-        // Allocate the full_image to hold all gathered data
-        full_image.create(ascii_image.rows * size, ascii_image.cols, ascii_image.type());
+    const bool seekable = info[1];
+    const int source_rows = info[2];
+    const int source_cols = info[3];
+    const cv::Size grid(info[6], info[7]);
+
+    if (seekable && my_rank != 0 && !reader.open(input_filepath))
+    {
+        throw std::runtime_error("Could not open the image: " + input_filepath);
+    }
+
+    // the rows of rank r are PNG chunk r; the text of every band is written as soon as it is converted
+    ImageWriter writer(output_filepath, info[4], info[5], grid, num_ranks, context, comm);
+
+    std::pair<int, int> my_cells = get_row_range(grid.height, my_rank, num_ranks);
+    // every band writes its slice of this directly
+    const int cell_height = converter.atlas().cell_height;
+    cv::Mat processed_image(cell_height * (my_cells.second - my_cells.first), converter.atlas().cell_width * grid.width, CV_8UC3);
+    profile_count_allocation(processed_image.total() * processed_image.elemSize());
+
+    // end of the band of cell rows starting at first_cell: as many whole cell rows as fit in STREAM_BAND_ROWS source rows, at least one
+    auto band_end = [&](int first_cell, int end_cell)
+    {
+        int start_row = get_source_row_range(source_rows, grid.height, first_cell, first_cell + 1).first;
+        int last_cell = first_cell + 1;
+        while (last_cell < end_cell && get_source_row_range(source_rows, grid.height, first_cell, last_cell + 1).second - start_row <= STREAM_BAND_ROWS)
+        {
+            ++last_cell;
+        }
+        return last_cell;
+    };
 
-        // Gather all images into full_image
-        MPI_Gatherv(ascii_image.data, send_count, MPI_UNSIGNED_CHAR,
-                    full_image.data, recvcounts.data(), displs.data(),
-                    MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
+    auto convert_band = [&](const cv::Mat &band, int first_cell, int end_cell)
+    {
+        cv::Mat band_image = processed_image.rowRange(cell_height * (first_cell - my_cells.first), cell_height * (end_cell - my_cells.first));
+        std::string band_text(static_cast<size_t>(end_cell - first_cell) * (grid.width + 1), '\n');
+        profile_count_allocation(band_text.size());
+        cv::Mat cell_colors;
+        if (writer.wants_cell_colors())
+        {
+            cell_colors.create(end_cell - first_cell, grid.width, CV_8UC3);
+        }
+        {
+            ScopedBusy busy;
+            converter.convert_area(band, source_rows, first_cell, end_cell, grid, *context.pool, &band_text[0], band_image, cell_colors.empty() ? nullptr : &cell_colors);
+        }
+        writer.add_text(first_cell, std::move(band_text), cell_colors);
+    };
 
-        // Save the full image at rank 0
-        std::string color_output_string = (colored_flag) ? "_color" : "";
-        cv::imwrite("outputs/" + output_filepath + color_output_string + ".png", full_image);
+    cv::Mat band;
+    if (seekable || my_rank != 0)
+    {
+        for (int first_cell = my_cells.first; first_cell < my_cells.second;)
+        {
+            int end_cell = band_end(first_cell, my_cells.second);
+            std::pair<int, int> rows = get_source_row_range(source_rows, grid.height, first_cell, end_cell);
+            if (seekable)
+            {
+                ScopedPhase phase(PHASE_LOAD);
+                reader.read_rows(rows.first, rows.second, band);
+            }
+            else
+            {
+                ScopedPhase phase(PHASE_DISTRIBUTE);
+                band.create(rows.second - rows.first, source_cols, CV_8UC3);
+                recv_bytes(band.data, band.total() * band.elemSize(), 0, 0, comm);
+            }
+            convert_band(band, first_cell, end_cell);
+            first_cell = end_cell;
+        }
     }
     else
     {
-        MPI_Gatherv(ascii_image.data, send_count, MPI_UNSIGNED_CHAR,
-                    nullptr, nullptr, nullptr,
-                    MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
+        // rank 0 walks down the image once, converting its own bands and sending every other rank its bands in order
+        for (int rank = 0; rank < num_ranks; ++rank)
+        {
+            std::pair<int, int> cells = get_row_range(grid.height, rank, num_ranks);
+            for (int first_cell = cells.first; first_cell < cells.second;)
+            {
+                int end_cell = band_end(first_cell, cells.second);
+                std::pair<int, int> rows = get_source_row_range(source_rows, grid.height, first_cell, end_cell);
+                {
+                    ScopedPhase phase(PHASE_LOAD);
+                    reader.read_rows(rows.first, rows.second, band);
+                }
+                if (rank == 0)
+                {
+                    convert_band(band, first_cell, end_cell);
+                }
+                else
+                {
+                    ScopedPhase phase(PHASE_DISTRIBUTE);
+                    send_bytes(band.data, band.total() * band.elemSize(), rank, 0, comm);
+                }
+                first_cell = end_cell;
+            }
+        }
     }
+    reader.close();
+    band.release();
+
+    writer.add_image(my_rank, processed_image);
+    processed_image.release();
+    profile_count_chunk();
+
+    writer.finish();
+    return true;
 }
 
-// write the ASCII art to a file using MPI I/O
-void write_ascii_art_to_file(const std::string &ascii_art, const std::string &output_filepath_txt, MPI_Comm comm, int my_rank, MPI_Offset initial_offset)
+// result cache key of converting input_filepath with the options of this run
+std::string get_cache_key(const std::string &input_filepath, const RunContext &context)
 {
-    MPI_File fh;
-    MPI_Status status;
-    MPI_Offset offset = 0;
+    int key_width = context.resize_flag ? context.desired_width : 0;
+    return context.cache->key(input_filepath, context.converter->config(), key_width, context.raster);
+}
 
-    // Calculate offset for ASCII art based on header size
-    int local_size = ascii_art.size();
-    MPI_Exscan(&local_size, &offset, 1, MPI_INT, MPI_SUM, comm);
+// Serve a conversion from the result cache: the cached text goes out under a header with this run's command
+// line, and both outputs are written straight from the mapped cache files, with no decode or render.
+// Returns false on a miss, and always with --ansi or --grid, since the cache keeps neither.
+bool write_cached_outputs(const std::string &cache_key, const std::string &output_filepath, const RunContext &context)
+{
+    if (context.ansi_mode != ANSI_NONE || context.grid_flag)
+    {
+        return false;
+    }
+
+    CachedResult cached;
+    if (!context.cache->lookup(cache_key, cached))
+    {
+        return false;
+    }
+
+    ScopedPhase phase(PHASE_WRITE);
+    std::string image_filepath = image_output_path(output_filepath, context);
+
+    std::ofstream text("outputs/" + output_filepath + ".txt", std::ios::binary | std::ios::trunc);
+    text << context.command_line << "\n";
+    text.write(cached.text.data() + cached.header_end, cached.text.size() - cached.header_end);
+
+    std::ofstream png(image_filepath, std::ios::binary | std::ios::trunc);
+    png.write(cached.png.data(), cached.png.size());
+
+    if (!text || !png)
+    {
+        throw std::runtime_error("Could not write outputs/" + output_filepath);
+    }
+
+    if (context.print_flag)
+    {
+        std::cout << "\n";
+        std::cout.write(cached.text.data() + cached.art_begin, cached.text.size() - cached.art_begin);
+        print_saved_message(output_filepath, image_filepath);
+    }
+    return true;
+}
+
+// copy the outputs just written for cache_key into the result cache
+void store_cached_outputs(const std::string &cache_key, const std::string &output_filepath, const RunContext &context)
+{
+    context.cache->store(cache_key, "outputs/" + output_filepath + ".txt", image_output_path(output_filepath, context));
+}
+
+// Convert one image file with every rank of comm, or copy its outputs from the result cache unless
+// check_cache is false because it was looked up already. Conversions are stored in the cache afterwards.
+void convert_file(const std::string &input_filepath, const std::string &output_filepath, const RunContext &context, bool check_cache, Comm comm)
+{
+    int my_rank = comm_rank(comm);
+
+    std::string cache_key;
+    bool cached = false;
+    if (context.cache && my_rank == 0)
+    {
+        cache_key = get_cache_key(input_filepath, context);
+        cached = check_cache && write_cached_outputs(cache_key, output_filepath, context);
+    }
+    broadcast_value(cached, comm);
+    if (cached)
+    {
+        return;
+    }
+
+    if (!context.stream_flag || !convert_image_streaming(input_filepath, output_filepath, context, comm))
+    {
+        cv::Mat input_image;
+        int desired_width = 0, desired_height = 0;
+        if (my_rank == 0)
+        {
+            input_image = prepare_image(input_filepath, context, desired_width, desired_height);
+        }
+        convert_image(input_image, output_filepath, desired_width, desired_height, context, comm);
+    }
+
+    // the collective writes have closed both outputs on every rank by now
+    if (context.cache && my_rank == 0)
+    {
+        store_cached_outputs(cache_key, output_filepath, context);
+    }
+}
+
+// print the peak resident set size of every rank of comm
+void report_peak_rss(Comm comm)
+{
+    int my_rank = comm_rank(comm);
+    int num_ranks = comm_size(comm);
+
+    // ru_maxrss is in KiB on Linux
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t peak_kib = usage.ru_maxrss;
+
+    std::vector<uint64_t> peaks;
+    gather_u64(&peak_kib, 1, peaks, 0, comm);
 
     if (my_rank == 0)
     {
-        offset = initial_offset;
+        std::cout << "Peak RSS per rank (MiB):";
+        for (int i = 0; i < num_ranks; ++i)
+        {
+            std::cout << " " << i << ":" << peaks[i] / 1024.0;
+        }
+        std::cout << "\n";
+    }
+}
+
+// Convert many images in one job. Rank 0 hands out whole images to workers that ask for them and
+// each worker converts its image alone. Images with more than BATCH_SPLIT_CELLS cells are sent
+// back and converted afterwards by all ranks together, split by rows.
+void run_batch(const std::vector<std::string> &files, const RunContext &context, int my_rank, int num_ranks)
+{
+    double start_time = comm_time();
+    int num_files = files.size();
+    int failed = 0;
+    std::vector<int> deferred;
+
+    // convert a whole image on this rank alone, unless it is big enough to be worth splitting
+    auto convert_alone = [&](int index, bool allow_defer) -> int
+    {
+        try
+        {
+            // a hit needs neither the pixels nor the grid
+            std::string output_filepath = get_basename(files[index]);
+            std::string cache_key;
+            if (context.cache)
+            {
+                check_file_exist(files[index]);
+                cache_key = get_cache_key(files[index], context);
+                if (write_cached_outputs(cache_key, output_filepath, context))
+                {
+                    return BATCH_DONE;
+                }
+            }
+
+            int desired_width = 0, desired_height = 0;
+            cv::Mat image = prepare_image(files[index], context, desired_width, desired_height);
+
+            cv::Size grid = context.converter->grid_size(desired_width, desired_height);
+            if (allow_defer && static_cast<long long>(grid.width) * grid.height > BATCH_SPLIT_CELLS)
+            {
+                return BATCH_DEFERRED;
+            }
+
+            check_file_exist(files[index]);
+            convert_image(image, output_filepath, desired_width, desired_height, context, COMM_SELF);
+            if (context.cache)
+            {
+                store_cached_outputs(cache_key, output_filepath, context);
+            }
+            return BATCH_DONE;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Skipping " << files[index] << ": " << e.what() << "\n";
+            return BATCH_FAILED;
+        }
+    };
+
+    if (num_ranks == 1)
+    {
+        for (int i = 0; i < num_files; ++i)
+        {
+            failed += (convert_alone(i, false) == BATCH_FAILED);
+        }
+    }
+    else if (my_rank == 0)
+    {
+        // master: answer every request with the next image, or -1 once the queue is empty
+        int next = 0;
+        int active_workers = num_ranks - 1;
+        while (active_workers > 0)
+        {
+            int report[2];
+            int worker = recv_bytes(report, sizeof(report), COMM_ANY_SOURCE, TAG_REQUEST, COMM_WORLD);
+
+            if (report[0] == BATCH_DEFERRED)
+            {
+                deferred.push_back(report[1]);
+            }
+            else if (report[0] == BATCH_FAILED)
+            {
+                ++failed;
+            }
+
+            int task = (next < num_files) ? next++ : -1;
+            if (task < 0)
+            {
+                --active_workers;
+            }
+            send_bytes(&task, sizeof(task), worker, TAG_TASK, COMM_WORLD);
+        }
     }
     else
     {
-        offset += initial_offset;
+        // worker: keep asking for images until the master runs out
+        int report[2] = {BATCH_READY, -1};
+        while (true)
+        {
+            int task;
+            send_bytes(report, sizeof(report), 0, TAG_REQUEST, COMM_WORLD);
+            recv_bytes(&task, sizeof(task), 0, TAG_TASK, COMM_WORLD);
+            if (task < 0)
+            {
+                break;
+            }
+
+            report[0] = convert_alone(task, true);
+            report[1] = task;
+        }
     }
-    // Open the file collectively
-    MPI_File_open(comm, output_filepath_txt.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
 
-    // Write ASCII art at calculated offset
-    MPI_File_write_at_all(fh, offset, ascii_art.c_str(), local_size, MPI_CHAR, &status);
+    // large images: every rank takes a stripe
+    int num_deferred = deferred.size();
+    broadcast_value(num_deferred, COMM_WORLD);
+    deferred.resize(num_deferred);
+    broadcast_bytes(deferred.data(), num_deferred * sizeof(int), COMM_WORLD);
 
-    // Close the file
-    MPI_File_close(&fh);
+    // the worker that deferred an image has looked it up in the cache already
+    for (int index : deferred)
+    {
+        if (my_rank == 0)
+        {
+            check_file_exist(files[index]);
+        }
+        convert_file(files[index], get_basename(files[index]), context, false, COMM_WORLD);
+    }
+
+    if (my_rank == 0)
+    {
+        double elapsed = comm_time() - start_time;
+        int converted = num_files - failed;
+        std::cout << "Converted " << converted << " of " << num_files << " images (" << num_deferred << " split across ranks) in "
+                  << elapsed << " seconds: " << converted / elapsed << " images/s\n";
+    }
 }
 
 int main(int argc, char **argv)
@@ -197,18 +961,11 @@ int main(int argc, char **argv)
     // Initialize MPI
     int my_rank, num_ranks;
 
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
-
-#ifdef TIME
-    double start_time = 0.0, end_time = 0.0;
+    comm_init(&argc, &argv);
+    my_rank = comm_rank(COMM_WORLD);
+    num_ranks = comm_size(COMM_WORLD);
 
-    if (my_rank == 0)
-    {
-        start_time = MPI_Wtime();
-    }
-#endif // TIME
+    double start_time = comm_time();
 
     std::string executable_name = argv[0];
 
@@ -220,7 +977,7 @@ int main(int argc, char **argv)
             show_usage(executable_name);
         }
 
-        MPI_Finalize();
+        comm_finalize();
         return EXIT_SUCCESS;
     }
 
@@ -230,128 +987,173 @@ int main(int argc, char **argv)
     bool negate_flag = false;
     bool print_flag = false;
     bool colored_flag = false;
+    bool rec601_flag = false;
+    bool area_flag = false;
+    bool shape_flag = false;
+    bool stream_flag = false;
+    bool profile_flag = false;
+    bool grid_flag = false;
     bool resize_flag = false;
     bool help_flag = false;
     int desired_width = 0;
     int thread_count = 0;
+    std::string characters = DEFAULT_CHARACTERS;
+    float scale_factor = DEFAULT_SCALE_FACTOR;
+    // only rank 0 runs the daemon, so the socket path is not broadcast
+    std::string listen_path;
+    bool daemon_flag = false;
+    std::string cache_dir;
+    long long cache_bytes = RESULT_CACHE_BYTES;
+    bool batch_flag = false;
+    bool video_flag = false;
+    // only rank 0 converts videos, so the delta format is not broadcast
+    std::string delta_format;
+    std::string ansi_format;
+    AnsiMode ansi_mode = ANSI_NONE;
+    std::string raster_format = "png";
+    RasterOptions raster;
+    std::vector<std::string> input_files;
 
     if (my_rank == 0)
     {
-        parse_arguments(argc, argv, input_filepath, output_filepath, executable_name, resize_flag, desired_width, print_flag, negate_flag, colored_flag, help_flag, thread_count);
-
-        // Reverse the characters used for ASCII art if negate_flag is set
-        if (negate_flag)
+        parse_arguments(argc, argv, input_filepath, output_filepath, executable_name, resize_flag, desired_width, print_flag, negate_flag, colored_flag, rec601_flag, area_flag, shape_flag, stream_flag, profile_flag, grid_flag, help_flag, thread_count, delta_format, ansi_format, raster_format, raster.png_level, characters, scale_factor, listen_path, cache_dir, cache_bytes);
+        daemon_flag = !listen_path.empty();
+        ansi_mode = parse_ansi_mode(ansi_format);
+        parse_raster_format(raster_format, raster.format);
+
+        // A directory or a list file of images turns on batch mode
+        get_image_files(input_filepath, input_files);
+        batch_flag = !input_files.empty();
+        video_flag = !batch_flag && is_video_input(input_filepath);
+
+        // Check if the input file exists; a daemon gets its inputs from its clients
+        if (!batch_flag && !daemon_flag)
         {
-            reverse_string(CHARACTERS);
+            check_file_exist(input_filepath);
         }
-
-        // Check if the input file exists
-        check_file_exist(input_filepath);
     }
 
-    std::pair<int, int> threads = calculate_thread_dimensions(thread_count);
-    int threads_x = threads.first;
-    int threads_y = threads.second;
-
     // Broadcast the configuration to all ranks
-    broadcast_config(input_filepath, output_filepath, resize_flag, desired_width, print_flag, negate_flag, colored_flag, help_flag, my_rank, CHARACTERS, threads_x, threads_y);
-
-    MPI_Barrier(MPI_COMM_WORLD);
+    broadcast_config(input_filepath, output_filepath, resize_flag, desired_width, print_flag, negate_flag, colored_flag, rec601_flag, area_flag, shape_flag, help_flag, my_rank, characters, scale_factor, thread_count, batch_flag, video_flag, daemon_flag, stream_flag, profile_flag, grid_flag, ansi_mode, raster, cache_dir, cache_bytes);
 
     if (help_flag)
     {
-        MPI_Finalize();
+        comm_finalize();
         exit(EXIT_SUCCESS);
     }
 
-    int desired_height = 0;
-    cv::Mat input_image;
+    RunContext context;
+    context.resize_flag = resize_flag;
+    context.desired_width = desired_width;
+    context.print_flag = print_flag;
+    context.stream_flag = stream_flag;
+    context.ansi_mode = ansi_mode;
+    context.grid_flag = grid_flag;
+    context.raster = raster;
+
+    ConverterConfig config;
+    config.characters = characters;
+    config.scale_factor = scale_factor;
+    config.negate_flag = negate_flag;
+    config.colored_flag = colored_flag;
+    config.rec601_flag = rec601_flag;
+    config.area_flag = area_flag;
+    config.shape_flag = shape_flag;
+
+#ifdef NO_MPI
+    context.command_line.clear();
+#else
+    context.command_line = "mpirun -np " + std::to_string(num_ranks) + " ";
+#endif // NO_MPI
+    context.command_line += std::string(argv[0]) + " ";
+    for (int i = 1; i < argc; ++i)
+    {
+        context.command_line += std::string(argv[i]) + " ";
+    }
 
 #ifdef USE_GPU
     map_rank_to_gpu(my_rank);
+
+    std::pair<int, int> threads = calculate_thread_dimensions(thread_count);
+    config.threads_x = threads.first;
+    config.threads_y = threads.second;
+
+    // thread_count is per GPU block here, so the host side of --area runs on one thread
+    ThreadPool pool(1);
+    context.pool = &pool;
+#else
+    // Worker threads that share this rank's stripe of rows
+    ThreadPool pool(thread_count);
+    context.pool = &pool;
 #endif // USE_GPU
 
-    if (my_rank == 0)
+    // Rasterizes every character and builds the gray-to-glyph table once for the whole run
+    const Converter converter(config);
+    context.converter = &converter;
+
+    // outputs of earlier runs, shared by every rank through the file system
+    std::unique_ptr<ResultCache> cache;
+    if (!cache_dir.empty())
     {
-        input_image = load_image(input_filepath);
+        cache.reset(new ResultCache(cache_dir, cache_bytes));
+        context.cache = cache.get();
+    }
 
-        // Resize the image to the desired width and height
-        if (resize_flag)
+    if (daemon_flag)
+    {
+        // jobs are spread across threads on rank 0; use -t for more workers
+        if (my_rank == 0)
         {
-            desired_height = (input_image.rows * desired_width) / input_image.cols;
+            if (num_ranks > 1)
+            {
+                std::cerr << "Note: the daemon runs on rank 0 only, the other " << num_ranks - 1 << " ranks stay idle.\n";
+            }
+            run_daemon(listen_path, config, thread_count);
         }
-        else
+    }
+    else if (video_flag)
+    {
+        // frames are pipelined across threads on rank 0; use -t for more conversion threads
+        if (my_rank == 0)
         {
-            desired_width = input_image.cols;
-            desired_height = input_image.rows;
+            if (num_ranks > 1)
+            {
+                std::cerr << "Note: video conversion runs on rank 0 only, the other " << num_ranks - 1 << " ranks stay idle.\n";
+            }
+            convert_video(input_filepath, output_filepath, context, parse_delta_format(delta_format));
         }
-
-        resize_image(input_image, desired_width, desired_height);
+    }
+    else if (batch_flag)
+    {
+        broadcast_file_list(input_files, my_rank);
+        run_batch(input_files, context, my_rank, num_ranks);
+    }
+    else
+    {
+        convert_file(input_filepath, output_filepath, context, true, COMM_WORLD);
     }
 
-    // Broadcast the calculated dimensions and type to all ranks
-    broadcast_image(input_image, my_rank, MPI_COMM_WORLD);
-
-    // Wait for all ranks to finish broadcasting
-    MPI_Barrier(MPI_COMM_WORLD);
-
-    // Split the image into parts for each rank
-    cv::Mat subimage = split_image(input_image, my_rank, num_ranks);
-
-    // Process the image to get the ASCII art string and the ASCII image
-#ifdef USE_GPU
-    std::pair<std::string, cv::Mat> process_output = process_image(subimage, colored_flag, threads_x, threads_y);
-#else
-    std::pair<std::string, cv::Mat> process_output = process_image(subimage, colored_flag);
-#endif // USE_GPU
-
-    std::string processed_string = process_output.first;
-    cv::Mat processed_image = process_output.second;
-
-    // Combine the ASCII art from all ranks into a single string and print it to the console
-    gather_and_print_to_console(processed_string, num_ranks, my_rank, print_flag, colored_flag, output_filepath);
-
-    // Gather the ASCII art from all ranks and save it to a file
-    gather_and_save_ascii_art(processed_image, my_rank, num_ranks, output_filepath, colored_flag);
-
-    // Write the header to MPI I/O file
-    std::string output_filepath_txt = "outputs/" + output_filepath + ".txt";
-    MPI_Offset initial_offset = 0;
-    std::string header;
-    if (my_rank == 0)
+    if (cache)
     {
-        header += "mpirun -np " + std::to_string(num_ranks) + " ";
-        header += std::string(argv[0]) + " ";
-        for (int i = 1; i < argc; ++i)
+        long long hits = allreduce_sum(cache->get_hits(), COMM_WORLD);
+        long long misses = allreduce_sum(cache->get_misses(), COMM_WORLD);
+        if (my_rank == 0)
         {
-            header += std::string(argv[i]) + " ";
+            std::cout << "Result cache: " << hits << " hits, " << misses << " misses\n";
         }
-        header += "\n";
-        header += "Dimensions: " + std::to_string(desired_width) + "x" + std::to_string(desired_height) + "\n\n";
-
-        MPI_File fh;
-        MPI_Status status;
-        MPI_File_open(MPI_COMM_SELF, output_filepath_txt.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
-        MPI_File_write(fh, header.c_str(), header.size(), MPI_CHAR, &status);
-        MPI_File_close(&fh);
-
-        initial_offset = header.size();
     }
 
-    MPI_Bcast(&initial_offset, 1, MPI_OFFSET, 0, MPI_COMM_WORLD);
-
-    // Write the ASCII art to a file
-    write_ascii_art_to_file(processed_string, output_filepath_txt, MPI_COMM_WORLD, my_rank, initial_offset);
+    if (stream_flag)
+    {
+        report_peak_rss(COMM_WORLD);
+    }
 
-#ifdef TIME
-    if (my_rank == 0)
+    if (profile_flag)
     {
-        end_time = MPI_Wtime();
-        std::cout << "Total execution time: " << end_time - start_time << " seconds" << std::endl;
+        write_profile_report("outputs/" + output_filepath + "_profile.json", comm_time() - start_time, context.command_line, thread_count, COMM_WORLD);
     }
-#endif // TIME
 
-    MPI_Finalize();
+    comm_finalize();
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
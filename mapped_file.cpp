@@ -0,0 +1,47 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    bool mapped = fstat(fd, &info) == 0;
+    if (mapped && info.st_size > 0)
+    {
+        void *pages = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        mapped = pages != MAP_FAILED;
+        if (mapped)
+        {
+            address = pages;
+            length = info.st_size;
+            madvise(address, length, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+    return mapped;
+}
+
+void MappedFile::close()
+{
+    if (address)
+    {
+        munmap(address, length);
+        address = nullptr;
+    }
+    length = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef __MAPPED_FILE_HPP__
+#define __MAPPED_FILE_HPP__
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only; an empty file maps to no data
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // returns false if the file cannot be opened or mapped
+    bool open(const std::string &path);
+    void close();
+
+    const char *data() const { return static_cast<const char *>(address); }
+    size_t size() const { return length; }
+
+private:
+    void *address = nullptr;
+    size_t length = 0;
+};
+
+#endif // __MAPPED_FILE_HPP__
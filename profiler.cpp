@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sys/resource.h>
+#include <vector>
+
+#include "profiler.hpp"
+
+static const char *PHASE_NAMES[NUM_PHASES] = {"broadcast", "load", "resize", "distribute", "convert", "render", "ansi_encode", "gather", "png_encode", "mpi_io_write"};
+
+// nanoseconds spent in each phase by this rank
+static std::atomic<int64_t> phase_nanoseconds[NUM_PHASES];
+
+// allocations, allocated bytes and copied bytes of this rank
+enum BufferCounter
+{
+    BUFFER_ALLOCATIONS = 0,
+    BUFFER_ALLOCATED_BYTES,
+    BUFFER_COPIED_BYTES,
+    NUM_BUFFER_COUNTERS
+};
+static const char *BUFFER_COUNTER_NAMES[NUM_BUFFER_COUNTERS] = {"allocations", "allocated_bytes", "copied_bytes"};
+static std::atomic<int64_t> buffer_counters[NUM_BUFFER_COUNTERS];
+
+// busy nanoseconds and converted chunks of this rank
+static std::atomic<int64_t> busy_nanoseconds;
+static std::atomic<int64_t> chunks_converted;
+
+void profile_add(Phase phase, std::chrono::steady_clock::duration elapsed)
+{
+    phase_nanoseconds[phase].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+}
+
+void profile_count_allocation(size_t bytes)
+{
+    buffer_counters[BUFFER_ALLOCATIONS].fetch_add(1, std::memory_order_relaxed);
+    buffer_counters[BUFFER_ALLOCATED_BYTES].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void profile_count_copy(size_t bytes)
+{
+    buffer_counters[BUFFER_COPIED_BYTES].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void profile_add_busy(std::chrono::steady_clock::duration elapsed)
+{
+    busy_nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+}
+
+void profile_count_chunk()
+{
+    chunks_converted.fetch_add(1, std::memory_order_relaxed);
+}
+
+// quote a string for JSON
+static std::string json_string(const std::string &text)
+{
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted += '\\';
+        }
+        quoted += (static_cast<unsigned char>(c) < 0x20) ? ' ' : c;
+    }
+    return quoted + "\"";
+}
+
+static void write_stats(std::ostream &out, double min, double max, double sum, int num_ranks)
+{
+    double mean = sum / num_ranks;
+    out << "{\"min\": " << min << ", \"max\": " << max << ", \"mean\": " << mean
+        << ", \"imbalance\": " << (mean > 0.0 ? max / mean : 1.0) << "}";
+}
+
+void write_profile_report(const std::string &filepath, double total_seconds, const std::string &command_line, int thread_count, Comm comm)
+{
+    int my_rank = comm_rank(comm);
+    int num_ranks = comm_size(comm);
+
+    // phases, then the total, then the buffer counters, so one reduction covers everything
+    const int TOTAL = NUM_PHASES;
+    const int BUFFERS = NUM_PHASES + 1;
+    const int NUM_VALUES = BUFFERS + NUM_BUFFER_COUNTERS;
+    double values[NUM_VALUES];
+    for (int i = 0; i < NUM_PHASES; ++i)
+    {
+        values[i] = phase_nanoseconds[i].load() * 1e-9;
+    }
+    values[TOTAL] = total_seconds;
+    for (int i = 0; i < NUM_BUFFER_COUNTERS; ++i)
+    {
+        values[BUFFERS + i] = static_cast<double>(buffer_counters[i].load());
+    }
+
+    double min[NUM_VALUES], max[NUM_VALUES], sum[NUM_VALUES];
+    reduce_min_max_sum(values, min, max, sum, NUM_VALUES, comm);
+
+    // busy time and chunks of every rank, to see how evenly the rows were shared out, and its peak
+    // resident set size (ru_maxrss is in KiB on Linux), to see what ranks sharing a node cost
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t rank_values[3] = {static_cast<uint64_t>(busy_nanoseconds.load()), static_cast<uint64_t>(chunks_converted.load()), static_cast<uint64_t>(usage.ru_maxrss)};
+    std::vector<uint64_t> per_rank;
+    gather_u64(rank_values, 3, per_rank, 0, comm);
+
+    if (my_rank != 0)
+    {
+        return;
+    }
+
+    std::ofstream out(filepath);
+    out << std::setprecision(6) << std::fixed;
+    out << "{\n";
+    out << "  \"command\": " << json_string(command_line) << ",\n";
+    out << "  \"ranks\": " << num_ranks << ",\n";
+    out << "  \"threads_per_rank\": " << thread_count << ",\n";
+    out << "  \"unit\": \"seconds\",\n";
+    out << "  \"total\": ";
+    write_stats(out, min[TOTAL], max[TOTAL], sum[TOTAL], num_ranks);
+    out << ",\n  \"phases\": {\n";
+    for (int i = 0; i < NUM_PHASES; ++i)
+    {
+        out << "    " << json_string(PHASE_NAMES[i]) << ": ";
+        write_stats(out, min[i], max[i], sum[i], num_ranks);
+        out << (i + 1 < NUM_PHASES ? ",\n" : "\n");
+    }
+    out << "  },\n  \"buffers\": {\n";
+    for (int i = 0; i < NUM_BUFFER_COUNTERS; ++i)
+    {
+        out << "    " << json_string(BUFFER_COUNTER_NAMES[i]) << ": ";
+        write_stats(out, min[BUFFERS + i], max[BUFFERS + i], sum[BUFFERS + i], num_ranks);
+        out << (i + 1 < NUM_BUFFER_COUNTERS ? ",\n" : "\n");
+    }
+    double busy_min = 0.0, busy_max = 0.0, busy_sum = 0.0;
+    for (int i = 0; i < num_ranks; ++i)
+    {
+        double seconds = per_rank[3 * i] * 1e-9;
+        busy_min = (i == 0) ? seconds : std::min(busy_min, seconds);
+        busy_max = std::max(busy_max, seconds);
+        busy_sum += seconds;
+    }
+    out << "  },\n  \"busy\": ";
+    write_stats(out, busy_min, busy_max, busy_sum, num_ranks);
+    out << ",\n  \"ranks\": [\n";
+    for (int i = 0; i < num_ranks; ++i)
+    {
+        out << "    {\"rank\": " << i << ", \"busy\": " << per_rank[3 * i] * 1e-9 << ", \"chunks\": " << per_rank[3 * i + 1]
+            << ", \"peak_rss_mib\": " << per_rank[3 * i + 2] / 1024.0 << "}" << (i + 1 < num_ranks ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+
+    std::cout << "Profile saved to " << filepath << "\n";
+}
@@ -0,0 +1,75 @@
+#ifndef __PROFILER_HPP__
+#define __PROFILER_HPP__
+
+#include <chrono>
+#include <string>
+
+#include "comm.hpp"
+
+// Phases of a run that every rank times, in the order they appear in the report
+enum Phase
+{
+    PHASE_BROADCAST = 0,  // configuration and file list broadcasts
+    PHASE_LOAD,           // decoding the input
+    PHASE_RESIZE,         // cv::resize to the grid (fused into convert with --area)
+    PHASE_DISTRIBUTE,     // sending every rank its rows
+    PHASE_CONVERT,        // pixels to glyph indices, summed over the threads of a rank
+    PHASE_RENDER,         // drawing glyphs into the ASCII image, summed over the threads of a rank
+    PHASE_ANSI,           // encoding the --ansi console output
+    PHASE_GATHER,         // collecting the text on rank 0 and printing it
+    PHASE_PNG,            // encoding and writing the rendered image (--format)
+    PHASE_WRITE,          // writing the text file through MPI-IO
+    NUM_PHASES
+};
+
+// add time to a phase of this rank; safe to call from any thread
+void profile_add(Phase phase, std::chrono::steady_clock::duration elapsed);
+
+// count a buffer of the text or ASCII image path allocated by this rank; safe to call from any thread
+void profile_count_allocation(size_t bytes);
+
+// count bytes of converted text or ASCII image copied from one buffer to another by this rank
+void profile_count_copy(size_t bytes);
+
+// add time this rank spent working on rows it owns (copying, converting, rendering, deflating them),
+// as opposed to waiting for other ranks; safe to call from any thread
+void profile_add_busy(std::chrono::steady_clock::duration elapsed);
+
+// count a chunk of rows converted by this rank
+void profile_count_chunk();
+
+// Times the enclosing scope and adds it to a phase when the scope ends
+class ScopedPhase
+{
+public:
+    explicit ScopedPhase(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~ScopedPhase() { profile_add(phase, std::chrono::steady_clock::now() - start); }
+
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+private:
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Times the enclosing scope as busy time of this rank
+class ScopedBusy
+{
+public:
+    ScopedBusy() : start(std::chrono::steady_clock::now()) {}
+    ~ScopedBusy() { profile_add_busy(std::chrono::steady_clock::now() - start); }
+
+    ScopedBusy(const ScopedBusy &) = delete;
+    ScopedBusy &operator=(const ScopedBusy &) = delete;
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+// Reduce the time of every phase, the total run time and the buffer counters over the ranks of comm
+// and have rank 0 write their min, max and mean as JSON to filepath, followed by the busy time, chunk
+// count and peak resident set size of every rank. Collective over comm.
+void write_profile_report(const std::string &filepath, double total_seconds, const std::string &command_line, int thread_count, Comm comm);
+
+#endif // __PROFILER_HPP__
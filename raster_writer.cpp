@@ -0,0 +1,518 @@
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+#include "raster_writer.hpp"
+#include "profiler.hpp"
+#include "utils.hpp"
+
+// PNG chunks may hold at most 2^31 - 1 bytes; stay well below that
+static const size_t MAX_CHUNK_DATA = size_t(1) << 30;
+
+// QOI ops and the 7 zero bytes and a one that end the stream
+static const uchar QOI_OP_INDEX = 0x00;
+static const uchar QOI_OP_DIFF = 0x40;
+static const uchar QOI_OP_LUMA = 0x80;
+static const uchar QOI_OP_RUN = 0xc0;
+static const uchar QOI_OP_RGB = 0xfe;
+static const uchar QOI_END[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+bool parse_raster_format(const std::string &name, RasterFormat &format)
+{
+    if (name == "png")
+    {
+        format = RASTER_PNG;
+    }
+    else if (name == "ppm")
+    {
+        format = RASTER_PPM;
+    }
+    else if (name == "qoi")
+    {
+        format = RASTER_QOI;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char *raster_extension(RasterFormat format)
+{
+    switch (format)
+    {
+    case RASTER_PPM:
+        return ".ppm";
+    case RASTER_QOI:
+        return ".qoi";
+    default:
+        return ".png";
+    }
+}
+
+static void append_be32(std::vector<uchar> &out, uint32_t value)
+{
+    out.push_back(static_cast<uchar>(value >> 24));
+    out.push_back(static_cast<uchar>(value >> 16));
+    out.push_back(static_cast<uchar>(value >> 8));
+    out.push_back(static_cast<uchar>(value));
+}
+
+// append a length + type + data + CRC chunk
+static void append_chunk(std::vector<uchar> &out, const char *type, const uchar *data, size_t size)
+{
+    append_be32(out, static_cast<uint32_t>(size));
+    size_t type_pos = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, &out[type_pos], static_cast<uInt>(4 + size));
+    append_be32(out, static_cast<uint32_t>(crc));
+}
+
+// Deflate the filtered scanlines of rows at level into a raw deflate stream. Every piece but the last of
+// the image ends with a sync flush, which byte-aligns the stream so pieces can simply be concatenated.
+static std::vector<uchar> deflate_rows(const cv::Mat &rows, bool last_piece, int level, uLong &adler)
+{
+    z_stream zs = {};
+    if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("Could not initialize zlib");
+    }
+
+    const int channels = rows.channels();
+    std::vector<uchar> scanline(1 + static_cast<size_t>(rows.cols) * channels);
+    std::vector<uchar> out;
+    out.reserve(scanline.size() * rows.rows / 4);
+
+    // run deflate until it has consumed all input, moving its output into out
+    uchar buffer[1 << 16];
+    auto pump = [&](int flush)
+    {
+        do
+        {
+            zs.next_out = buffer;
+            zs.avail_out = sizeof(buffer);
+            deflate(&zs, flush);
+            out.insert(out.end(), buffer, buffer + sizeof(buffer) - zs.avail_out);
+        } while (zs.avail_out == 0);
+    };
+
+    adler = adler32(0L, Z_NULL, 0);
+
+    for (int y = 0; y < rows.rows; ++y)
+    {
+        // filter type 0 (None), then the pixels in RGB order
+        const uchar *src = rows.ptr<uchar>(y);
+        scanline[0] = 0;
+        for (int x = 0; x < rows.cols; ++x)
+        {
+            uchar *dst = &scanline[1 + static_cast<size_t>(x) * channels];
+            for (int c = 0; c < channels; ++c)
+            {
+                dst[c] = src[x * channels + (channels == 3 ? 2 - c : c)];
+            }
+        }
+
+        adler = adler32(adler, scanline.data(), static_cast<uInt>(scanline.size()));
+        zs.next_in = scanline.data();
+        zs.avail_in = static_cast<uInt>(scanline.size());
+        pump(Z_NO_FLUSH);
+    }
+
+    pump(last_piece ? Z_FINISH : Z_SYNC_FLUSH);
+    deflateEnd(&zs);
+
+    return out;
+}
+
+// copy rows to out as PPM stores them, RGB (or gray) with nothing between rows
+static void copy_ppm_rows(const cv::Mat &rows, uchar *out)
+{
+    const int channels = rows.channels();
+    for (int y = 0; y < rows.rows; ++y)
+    {
+        const uchar *src = rows.ptr<uchar>(y);
+        if (channels != 3)
+        {
+            std::copy(src, src + static_cast<size_t>(rows.cols) * channels, out);
+            out += static_cast<size_t>(rows.cols) * channels;
+            continue;
+        }
+        for (int x = 0; x < rows.cols; ++x, out += 3)
+        {
+            out[0] = src[3 * x + 2];
+            out[1] = src[3 * x + 1];
+            out[2] = src[3 * x];
+        }
+    }
+}
+
+// Encode the pixels of rows as QOI ops. A decoder starts the image with a black previous pixel and an empty
+// index; unless restart is set the ops assume just that. With restart the first pixel is written in full,
+// which sets the previous pixel and its index entry whatever came before, and the index is only used for
+// pixels seen since, so the ops can follow those of any other piece. A run never crosses the end of rows.
+static std::vector<uchar> encode_qoi_rows(const cv::Mat &rows, bool restart)
+{
+    // at most an RGB op per pixel
+    std::vector<uchar> out(rows.total() * 4);
+    uchar *o = out.data();
+
+    // pixels packed as 0xffRRGGBB, so an index entry never written (0) never matches
+    uint32_t index[64] = {0};
+    uint32_t previous = 0xff000000u;
+    bool write_full = restart;
+    int run = 0;
+
+    for (int y = 0; y < rows.rows; ++y)
+    {
+        const uchar *src = rows.ptr<uchar>(y);
+        for (int x = 0; x < rows.cols; ++x)
+        {
+            const int r = src[3 * x + 2], g = src[3 * x + 1], b = src[3 * x];
+            const uint32_t pixel = 0xff000000u | (r << 16) | (g << 8) | b;
+
+            if (pixel == previous && !write_full)
+            {
+                if (++run == 62)
+                {
+                    *o++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                *o++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            // alpha is always 255
+            const int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+            if (index[hash] == pixel && !write_full)
+            {
+                *o++ = QOI_OP_INDEX | hash;
+            }
+            else
+            {
+                index[hash] = pixel;
+                const int8_t vr = static_cast<int8_t>(r - ((previous >> 16) & 0xff));
+                const int8_t vg = static_cast<int8_t>(g - ((previous >> 8) & 0xff));
+                const int8_t vb = static_cast<int8_t>(b - (previous & 0xff));
+                const int vg_r = vr - vg;
+                const int vg_b = vb - vg;
+
+                if (!write_full && vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+                {
+                    *o++ = QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+                }
+                else if (!write_full && vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+                {
+                    *o++ = QOI_OP_LUMA | (vg + 32);
+                    *o++ = static_cast<uchar>(((vg_r + 8) << 4) | (vg_b + 8));
+                }
+                else
+                {
+                    *o++ = QOI_OP_RGB;
+                    *o++ = static_cast<uchar>(r);
+                    *o++ = static_cast<uchar>(g);
+                    *o++ = static_cast<uchar>(b);
+                }
+            }
+            previous = pixel;
+            write_full = false;
+        }
+    }
+    if (run > 0)
+    {
+        *o++ = QOI_OP_RUN | (run - 1);
+    }
+
+    out.resize(o - out.data());
+    out.shrink_to_fit();
+    return out;
+}
+
+// Encode one stripe of the image, split into one piece of rows per thread of pool. adler is the Adler-32
+// of the stripe's PNG scanlines.
+static std::vector<uchar> encode_stripe(const cv::Mat &stripe, bool first_stripe, bool last_stripe, const RasterOptions &options, ThreadPool &pool, uLong &adler)
+{
+    adler = adler32(0L, Z_NULL, 0);
+    if (options.format == RASTER_PPM)
+    {
+        std::vector<uchar> out(stripe.total() * stripe.elemSize());
+        const size_t row_bytes = static_cast<size_t>(stripe.cols) * stripe.elemSize();
+        pool.parallel_for(0, stripe.rows, [&](int start_row, int end_row)
+                          { copy_ppm_rows(stripe.rowRange(start_row, end_row), &out[start_row * row_bytes]); });
+        return out;
+    }
+    if (options.format == RASTER_QOI && stripe.type() != CV_8UC3)
+    {
+        throw std::invalid_argument("QOI output needs an 8-bit 3-channel image");
+    }
+
+    const int num_pieces = std::max(1, std::min(pool.size(), stripe.rows));
+    std::vector<std::vector<uchar>> pieces(num_pieces);
+    std::vector<uLong> adlers(num_pieces, adler);
+    pool.parallel_for(0, num_pieces, [&](int begin, int end)
+                      {
+        for (int p = begin; p < end; ++p)
+        {
+            std::pair<int, int> rows = get_row_range(stripe.rows, p, num_pieces);
+            cv::Mat piece = stripe.rowRange(rows.first, rows.second);
+            if (options.format == RASTER_QOI)
+            {
+                pieces[p] = encode_qoi_rows(piece, !(first_stripe && p == 0));
+            }
+            else
+            {
+                pieces[p] = deflate_rows(piece, last_stripe && p == num_pieces - 1, options.png_level, adlers[p]);
+            }
+        } });
+
+    if (num_pieces == 1)
+    {
+        adler = adlers[0];
+        return std::move(pieces[0]);
+    }
+
+    size_t total = 0;
+    for (const std::vector<uchar> &piece : pieces)
+    {
+        total += piece.size();
+    }
+    std::vector<uchar> out;
+    out.reserve(total);
+    const size_t scanline_bytes = 1 + static_cast<size_t>(stripe.cols) * stripe.channels();
+    for (int p = 0; p < num_pieces; ++p)
+    {
+        std::pair<int, int> rows = get_row_range(stripe.rows, p, num_pieces);
+        adler = adler32_combine(adler, adlers[p], static_cast<z_off_t>((rows.second - rows.first) * scanline_bytes));
+        out.insert(out.end(), pieces[p].begin(), pieces[p].end());
+        pieces[p] = std::vector<uchar>();
+    }
+    profile_count_copy(total);
+    return out;
+}
+
+// the bytes of the file before the first chunk
+static std::vector<uchar> raster_header(const RasterOptions &options, int cols, long long rows, int channels)
+{
+    std::vector<uchar> header;
+    if (options.format == RASTER_PPM)
+    {
+        std::string text = std::string(channels == 3 ? "P6" : "P5") + "\n" + std::to_string(cols) + " " + std::to_string(rows) + "\n255\n";
+        header.assign(text.begin(), text.end());
+    }
+    else if (options.format == RASTER_QOI)
+    {
+        header = {'q', 'o', 'i', 'f'};
+        append_be32(header, static_cast<uint32_t>(cols));
+        append_be32(header, static_cast<uint32_t>(rows));
+        // RGB, sRGB with linear alpha
+        header.push_back(3);
+        header.push_back(0);
+    }
+    else
+    {
+        static const uchar signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        header.assign(signature, signature + 8);
+
+        std::vector<uchar> ihdr;
+        append_be32(ihdr, static_cast<uint32_t>(cols));
+        append_be32(ihdr, static_cast<uint32_t>(rows));
+        // 8-bit RGB or grayscale, deflate, adaptive filtering, no interlace
+        ihdr.push_back(8);
+        ihdr.push_back(channels == 3 ? 2 : 0);
+        ihdr.push_back(0);
+        ihdr.push_back(0);
+        ihdr.push_back(0);
+        append_chunk(header, "IHDR", ihdr.data(), ihdr.size());
+    }
+    return header;
+}
+
+// bytes one chunk takes up in the file, given the size it was encoded to: the header before the first
+// chunk and the trailer after the last, and for PNG the zlib header and Adler-32 and the IDAT framing
+static long long chunk_file_bytes(const RasterOptions &options, size_t header_size, long long encoded, bool first, bool last)
+{
+    long long bytes = (first ? header_size : 0) + encoded;
+    if (options.format == RASTER_QOI)
+    {
+        bytes += last ? sizeof(QOI_END) : 0;
+    }
+    else if (options.format == RASTER_PNG)
+    {
+        long long payload = encoded + (first ? 2 : 0) + (last ? 4 : 0);
+        long long idat_chunks = (payload + MAX_CHUNK_DATA - 1) / MAX_CHUNK_DATA;
+        bytes += payload - encoded + 12 * idat_chunks + (last ? 12 : 0);
+    }
+    return bytes;
+}
+
+// The pieces of the file one chunk is written as, back to back. The encoded bytes are moved in as they are,
+// except for PNG, where they are framed into IDAT chunks along with the zlib header on the first chunk and
+// the Adler-32 of every scanline, combined, on the last.
+static std::vector<std::vector<uchar>> frame_chunk(const RasterOptions &options, const std::vector<uchar> &header, std::vector<uchar> encoded, bool first, bool last, uLong combined_adler)
+{
+    std::vector<std::vector<uchar>> segments;
+    if (options.format != RASTER_PNG)
+    {
+        if (first)
+        {
+            segments.push_back(header);
+        }
+        segments.push_back(std::move(encoded));
+        if (options.format == RASTER_QOI && last)
+        {
+            segments.emplace_back(QOI_END, QOI_END + sizeof(QOI_END));
+        }
+        return segments;
+    }
+
+    std::vector<uchar> idat;
+    idat.reserve(encoded.size() + 6);
+    if (first)
+    {
+        // CMF, then FLG with the compression level for information
+        const uchar level_flags[10] = {0x01, 0x01, 0x5e, 0x5e, 0x5e, 0x5e, 0x9c, 0xda, 0xda, 0xda};
+        idat.push_back(0x78);
+        idat.push_back(level_flags[std::max(0, std::min(9, options.png_level))]);
+    }
+    idat.insert(idat.end(), encoded.begin(), encoded.end());
+    encoded = std::vector<uchar>();
+    if (last)
+    {
+        append_be32(idat, static_cast<uint32_t>(combined_adler));
+    }
+
+    std::vector<uchar> out;
+    out.reserve(header.size() + idat.size() + idat.size() / MAX_CHUNK_DATA * 12 + 64);
+    if (first)
+    {
+        out = header;
+    }
+    for (size_t pos = 0; pos < idat.size(); pos += MAX_CHUNK_DATA)
+    {
+        append_chunk(out, "IDAT", &idat[pos], std::min(MAX_CHUNK_DATA, idat.size() - pos));
+    }
+    if (last)
+    {
+        append_chunk(out, "IEND", nullptr, 0);
+    }
+    segments.push_back(std::move(out));
+    return segments;
+}
+
+// the fields of every chunk in RasterChunkWriter::fields
+enum ChunkField
+{
+    FIELD_ROWS = 0,
+    FIELD_COLS,
+    FIELD_CHANNELS,
+    FIELD_ADLER,
+    FIELD_LENGTH,
+    FIELD_ENCODED,
+    NUM_FIELDS
+};
+
+RasterChunkWriter::RasterChunkWriter(int num_chunks, const RasterOptions &options, ThreadPool &pool)
+    : num_chunks(num_chunks), options(options), pool(pool), fields(static_cast<size_t>(num_chunks) * NUM_FIELDS, 0)
+{
+}
+
+void RasterChunkWriter::add(int chunk, const cv::Mat &stripe)
+{
+    ScopedBusy busy;
+    uLong adler;
+    encoded.push_back(encode_stripe(stripe, chunk == 0, chunk == num_chunks - 1, options, pool, adler));
+    chunk_ids.push_back(chunk);
+
+    long long *field = &fields[static_cast<size_t>(chunk) * NUM_FIELDS];
+    field[FIELD_ROWS] = stripe.rows;
+    field[FIELD_COLS] = stripe.cols;
+    field[FIELD_CHANNELS] = stripe.channels();
+    field[FIELD_ADLER] = adler;
+    field[FIELD_LENGTH] = static_cast<long long>(stripe.rows) * (1 + static_cast<size_t>(stripe.cols) * stripe.channels());
+    field[FIELD_ENCODED] = encoded.back().size();
+}
+
+void RasterChunkWriter::write(const std::string &filepath, Comm comm)
+{
+    // only the owner fills in a chunk, so the sum over ranks gives every rank all of them
+    std::vector<long long> all(fields.size());
+    allreduce_sum(fields.data(), all.data(), static_cast<int>(fields.size()), comm);
+
+    long long total_rows = 0;
+    for (int c = 0; c < num_chunks; ++c)
+    {
+        total_rows += all[c * NUM_FIELDS + FIELD_ROWS];
+    }
+    std::vector<uchar> header = raster_header(options, static_cast<int>(all[FIELD_COLS]), total_rows, static_cast<int>(all[FIELD_CHANNELS]));
+
+    // every chunk goes right after the one before it
+    std::vector<long long> offsets(num_chunks + 1, 0);
+    for (int c = 0; c < num_chunks; ++c)
+    {
+        offsets[c + 1] = offsets[c] + chunk_file_bytes(options, header.size(), all[c * NUM_FIELDS + FIELD_ENCODED], c == 0, c == num_chunks - 1);
+    }
+
+    ParallelFile file(filepath, comm);
+    file.set_size(offsets[num_chunks]);
+
+    // kept until the file is closed, as the writes are nonblocking
+    std::vector<std::vector<uchar>> outs;
+    for (size_t i = 0; i < chunk_ids.size(); ++i)
+    {
+        const bool first = (chunk_ids[i] == 0);
+        const bool last = (chunk_ids[i] == num_chunks - 1);
+
+        // the zlib trailer is the Adler-32 of all scanlines, combined from every chunk's checksum
+        uLong combined = adler32(0L, Z_NULL, 0);
+        if (last && options.format == RASTER_PNG)
+        {
+            for (int c = 0; c < num_chunks; ++c)
+            {
+                combined = adler32_combine(combined, static_cast<uLong>(all[c * NUM_FIELDS + FIELD_ADLER]), static_cast<z_off_t>(all[c * NUM_FIELDS + FIELD_LENGTH]));
+            }
+        }
+
+        long long offset = offsets[chunk_ids[i]];
+        for (std::vector<uchar> &segment : frame_chunk(options, header, std::move(encoded[i]), first, last, combined))
+        {
+            if (!segment.empty())
+            {
+                file.iwrite_at(offset, segment.data(), segment.size());
+                offset += segment.size();
+                outs.push_back(std::move(segment));
+            }
+        }
+    }
+    file.close();
+
+    chunk_ids.clear();
+    encoded.clear();
+}
+
+std::vector<uchar> encode_raster(const cv::Mat &image, const RasterOptions &options, ThreadPool &pool)
+{
+    uLong adler;
+    std::vector<uchar> body = encode_stripe(image, true, true, options, pool, adler);
+    std::vector<uchar> header = raster_header(options, image.cols, image.rows, image.channels());
+
+    std::vector<std::vector<uchar>> segments = frame_chunk(options, header, std::move(body), true, true, adler);
+    if (segments.size() == 1)
+    {
+        return std::move(segments[0]);
+    }
+    std::vector<uchar> out;
+    for (const std::vector<uchar> &segment : segments)
+    {
+        out.insert(out.end(), segment.begin(), segment.end());
+    }
+    return out;
+}
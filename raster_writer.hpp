@@ -0,0 +1,64 @@
+#ifndef __RASTER_WRITER_HPP__
+#define __RASTER_WRITER_HPP__
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "comm.hpp"
+#include "constants.hpp"
+#include "thread_pool.hpp"
+
+// File formats of the rendered ASCII image
+enum RasterFormat
+{
+    RASTER_PNG = 0, // deflate at png_level, 0 (stored) to 9 (smallest)
+    RASTER_PPM = 1, // raw binary PPM, no compression at all
+    RASTER_QOI = 2  // "Quite OK Image", lossless and byte-oriented, much faster to encode than deflate
+};
+
+// How the rendered image is encoded
+struct RasterOptions
+{
+    RasterFormat format = RASTER_PNG;
+    int png_level = constants::PNG_COMPRESSION_LEVEL;
+};
+
+// parse the argument of --format ("png", "ppm" or "qoi"); returns false for anything else
+bool parse_raster_format(const std::string &name, RasterFormat &format);
+
+// ".png", ".ppm" or ".qoi"
+const char *raster_extension(RasterFormat format);
+
+// Writes an image split into num_chunks stripes of rows, which the ranks of comm hold between them in any
+// arrangement, as one file with the stripes in chunk order. Each rank encodes a chunk as soon as it hands
+// it over, split into one piece per thread of pool that are encoded independently and concatenated: raw
+// deflate streams that end byte-aligned for PNG, and QOI streams whose first pixel restarts the state.
+// Only the encoded bytes are kept; write then places every chunk at its offset with a ParallelFile. No
+// rank ever holds more than its own rows.
+class RasterChunkWriter
+{
+public:
+    // pool must be idle whenever add is called
+    RasterChunkWriter(int num_chunks, const RasterOptions &options, ThreadPool &pool);
+
+    // encode stripe, the rows of chunk
+    void add(int chunk, const cv::Mat &stripe);
+
+    // write every rank's chunks to filepath; collective over comm
+    void write(const std::string &filepath, Comm comm);
+
+private:
+    int num_chunks;
+    RasterOptions options;
+    ThreadPool &pool;
+    std::vector<int> chunk_ids;
+    std::vector<std::vector<uchar>> encoded;
+    // rows, columns, channels, Adler-32, scanline bytes and encoded size of every chunk, filled in for this rank's chunks
+    std::vector<long long> fields;
+};
+
+// encode a whole image to the bytes of a file, the same way a single chunk is written, on the threads of pool
+std::vector<uchar> encode_raster(const cv::Mat &image, const RasterOptions &options, ThreadPool &pool);
+
+#endif // __RASTER_WRITER_HPP__
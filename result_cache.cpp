@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "result_cache.hpp"
+
+// bump whenever the conversion changes its output for the same options, so old entries stop matching
+static const char *CACHE_FORMAT = "v1";
+
+static const uint64_t PRIME_1 = 0x9e3779b185ebca87ULL;
+static const uint64_t PRIME_2 = 0xc2b2ae3d27d4eb4fULL;
+static const uint64_t PRIME_3 = 0x165667b19e3779f9ULL;
+
+static inline uint64_t rotate_left(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static inline uint64_t hash_round(uint64_t lane, uint64_t word)
+{
+    return rotate_left(lane + word * PRIME_2, 31) * PRIME_1;
+}
+
+// Four independent lanes of 8-byte words, so the multiplies of consecutive words overlap;
+// the same construction as xxHash64, without its exact constants for the tail
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t lanes[4] = {seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1};
+
+    size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32)
+    {
+        for (int k = 0; k < 4; ++k)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + pos + 8 * k, sizeof(word));
+            lanes[k] = hash_round(lanes[k], word);
+        }
+    }
+
+    uint64_t hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+    for (int k = 0; k < 4; ++k)
+    {
+        hash = (hash ^ hash_round(0, lanes[k])) * PRIME_1 + PRIME_3;
+    }
+    hash += size;
+
+    for (; pos + 8 <= size; pos += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes + pos, sizeof(word));
+        hash = rotate_left(hash ^ hash_round(0, word), 27) * PRIME_1 + PRIME_3;
+    }
+    for (; pos < size; ++pos)
+    {
+        hash = rotate_left(hash ^ (bytes[pos] * PRIME_3), 11) * PRIME_1;
+    }
+
+    // final avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// copy a file to a temporary name next to target, then rename it into place
+static bool copy_file_atomically(const std::string &source, const std::string &target)
+{
+    MappedFile input;
+    if (!input.open(source))
+    {
+        return false;
+    }
+
+    std::string temporary = target + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        output.write(input.data(), input.size());
+        if (!output)
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), target.c_str()) == 0;
+}
+
+ResultCache::ResultCache(const std::string &directory, long long max_bytes) : directory(directory), max_bytes(max_bytes)
+{
+    // create every missing level of the directory
+    for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1))
+    {
+        mkdir(directory.substr(0, slash).c_str(), 0755);
+        if (slash == std::string::npos)
+        {
+            break;
+        }
+    }
+}
+
+std::string ResultCache::key(const std::string &input_filepath, const ConverterConfig &config, int desired_width, const RasterOptions &raster) const
+{
+    MappedFile input;
+    if (!input.open(input_filepath))
+    {
+        return "";
+    }
+    uint64_t content_hash = hash_bytes(input.data(), input.size(), 0);
+
+    // every option that changes the text or the image
+    std::ostringstream options;
+    options << CACHE_FORMAT << ' ' << input.size() << ' ' << config.characters.size() << ':' << config.characters << ' '
+            << config.negate_flag << config.colored_flag << config.rec601_flag << config.area_flag << config.shape_flag << ' '
+            << desired_width << ' ' << config.cell_width << 'x' << config.cell_height << ' '
+            << raster_extension(raster.format) << raster.png_level << ' ';
+    options.precision(9);
+    options << config.scale_factor;
+    std::string option_text = options.str();
+    uint64_t option_hash = hash_bytes(option_text.data(), option_text.size(), content_hash);
+
+    char hex[33];
+    std::snprintf(hex, sizeof(hex), "%016llx%016llx", static_cast<unsigned long long>(content_hash), static_cast<unsigned long long>(option_hash));
+    return hex;
+}
+
+bool ResultCache::lookup(const std::string &key, CachedResult &result)
+{
+    std::string text_filepath = directory + "/" + key + ".txt";
+    std::string png_filepath = directory + "/" + key + ".png";
+    if (key.empty() || !result.text.open(text_filepath) || !result.png.open(png_filepath))
+    {
+        ++misses;
+        return false;
+    }
+
+    const char *text = result.text.data();
+    const char *end = text + result.text.size();
+    const char *header_end = std::find(text, end, '\n');
+    const char *blank_line = std::search(header_end, end, "\n\n", "\n\n" + 2);
+    if (header_end == end || blank_line == end)
+    {
+        ++misses;
+        return false;
+    }
+    result.header_end = header_end + 1 - text;
+    result.art_begin = blank_line + 2 - text;
+
+    // a hit makes the entry the most recently used
+    utimensat(AT_FDCWD, text_filepath.c_str(), nullptr, 0);
+    utimensat(AT_FDCWD, png_filepath.c_str(), nullptr, 0);
+    ++hits;
+    return true;
+}
+
+void ResultCache::store(const std::string &key, const std::string &text_filepath, const std::string &png_filepath)
+{
+    if (key.empty())
+    {
+        return;
+    }
+    // the PNG goes in first, so a lookup never finds a text without its image
+    if (copy_file_atomically(png_filepath, directory + "/" + key + ".png"))
+    {
+        copy_file_atomically(text_filepath, directory + "/" + key + ".txt");
+    }
+    evict();
+}
+
+// remove whole entries, oldest modification time first, until the directory fits in max_bytes
+void ResultCache::evict()
+{
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+    {
+        return;
+    }
+
+    // size and last use of every entry, by key
+    std::map<std::string, std::pair<long long, time_t>> entries;
+    long long total_bytes = 0;
+    while (struct dirent *file = readdir(dir))
+    {
+        std::string name = file->d_name;
+        size_t dot = name.rfind('.');
+        if (dot == std::string::npos || (name.compare(dot, std::string::npos, ".txt") != 0 && name.compare(dot, std::string::npos, ".png") != 0))
+        {
+            continue;
+        }
+
+        struct stat info;
+        if (stat((directory + "/" + name).c_str(), &info) != 0)
+        {
+            continue;
+        }
+        std::pair<long long, time_t> &entry = entries[name.substr(0, dot)];
+        entry.first += info.st_size;
+        entry.second = std::max(entry.second, info.st_mtime);
+        total_bytes += info.st_size;
+    }
+    closedir(dir);
+
+    if (total_bytes <= max_bytes)
+    {
+        return;
+    }
+
+    std::vector<std::pair<time_t, std::string>> by_age;
+    for (const auto &entry : entries)
+    {
+        by_age.emplace_back(entry.second.second, entry.first);
+    }
+    std::sort(by_age.begin(), by_age.end());
+
+    for (const auto &entry : by_age)
+    {
+        if (total_bytes <= max_bytes)
+        {
+            break;
+        }
+        std::remove((directory + "/" + entry.second + ".txt").c_str());
+        std::remove((directory + "/" + entry.second + ".png").c_str());
+        total_bytes -= entries[entry.second].first;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef __RESULT_CACHE_HPP__
+#define __RESULT_CACHE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "converter.hpp"
+#include "mapped_file.hpp"
+#include "raster_writer.hpp"
+
+// 64-bit hash of size bytes, fast enough to run over every input file before deciding to convert it
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed);
+
+// The outputs of one earlier conversion, mapped straight from the cache
+struct CachedResult
+{
+    MappedFile text;
+    // the rendered image, in the format its key was built with
+    MappedFile png;
+    // the text starts with the command line that produced it, then the dimensions and a blank line
+    size_t header_end = 0; // just after the command line
+    size_t art_begin = 0;  // just after the blank line
+};
+
+// On-disk cache of conversion outputs, content-addressed by the input file's bytes and every option that
+// changes the output. Each entry is a <key>.txt and the image as <key>.png, whatever its format, in directory. Hits refresh the files'
+// modification time, and storing an entry evicts the least recently used ones until the directory fits in
+// max_bytes. Entries are written to a temporary name and renamed, so ranks and processes can share a
+// cache directory.
+class ResultCache
+{
+public:
+    ResultCache(const std::string &directory, long long max_bytes);
+
+    // Key of converting input_filepath with config at desired_width characters (0 keeps the image width),
+    // with the image encoded as raster says. Returns an empty key if the input cannot be read.
+    std::string key(const std::string &input_filepath, const ConverterConfig &config, int desired_width, const RasterOptions &raster) const;
+
+    // map the outputs stored under key; counts a hit or a miss
+    bool lookup(const std::string &key, CachedResult &result);
+
+    // copy freshly written outputs into the cache under key, then evict down to max_bytes
+    void store(const std::string &key, const std::string &text_filepath, const std::string &png_filepath);
+
+    long long get_hits() const { return hits; }
+    long long get_misses() const { return misses; }
+
+private:
+    void evict();
+
+    std::string directory;
+    long long max_bytes;
+    long long hits = 0;
+    long long misses = 0;
+};
+
+#endif // __RESULT_CACHE_HPP__
@@ -17,7 +17,7 @@ for (( i=0; i<num_configs; i++ )); do
 
 module load xl_r spectrum-mpi cuda/11.2
 
-mpirun -np ${RANK[i]} .././image_to_ascii -i ../images/hwoarang.png -w ${WIDTH[i]} -c -t 256
+mpirun -np ${RANK[i]} ../out -i ../images/hwoarang.png -w ${WIDTH[i]} -c -t 256
 EOF
 
     sbatch "$job_script"
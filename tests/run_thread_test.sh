@@ -0,0 +1,24 @@
+#!/bin/bash
+
+source ./thread_template.sh
+
+for (( i=0; i<num_configs; i++ )); do
+    job_script="thread_job_script_${NUM[i]}.sh"
+
+    cat > "$job_script" << EOF2
+#!/bin/bash
+#SBATCH --job-name=threads${NUM[i]}
+#SBATCH --nodes=${NODES[i]}
+#SBATCH --ntasks-per-node=${NTASKS[i]}
+#SBATCH --cpus-per-task=${THREADS[i]}
+#SBATCH --time=00:03:00
+#SBATCH --partition=el8
+#SBATCH --output=${OUTPUT[i]}
+
+module load xl_r spectrum-mpi
+
+mpirun -np ${RANK[i]} --bind-to socket ../out -i ../images/hwoarang.png -w ${WIDTH[i]} -c -t ${THREADS[i]}
+EOF2
+
+    sbatch "$job_script"
+done
@@ -0,0 +1,12 @@
+#!/bin/bash
+
+# One rank per socket, scaling the CPU thread pool instead of the number of ranks
+NUM=("1" "2" "4" "8" "16" "32")
+NODES=("1" "1" "1" "1" "1" "1")
+NTASKS=("2" "2" "2" "2" "2" "2")
+THREADS=("1" "2" "4" "8" "16" "32")
+OUTPUT=("1_thread_data.txt" "2_thread_data.txt" "4_thread_data.txt" "8_thread_data.txt" "16_thread_data.txt" "32_thread_data.txt")
+RANK=("2" "2" "2" "2" "2" "2")
+WIDTH=("10000" "10000" "10000" "10000" "10000" "10000")
+
+num_configs=${#NODES[@]}
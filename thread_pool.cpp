@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+// same remainder-aware split the ranks use
+static void band_range(int begin, int end, int band, int num_bands, int &band_begin, int &band_end)
+{
+    std::pair<int, int> range = get_row_range(end - begin, band, num_bands);
+    band_begin = begin + range.first;
+    band_end = begin + range.second;
+}
+
+ThreadPool::ThreadPool(int num_threads) : num_threads(std::max(1, num_threads))
+{
+    for (int i = 1; i < this->num_threads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::worker_loop(int worker_id)
+{
+    int seen_generation = 0;
+
+    while (true)
+    {
+        const std::function<void(int, int)> *band = nullptr;
+        int begin = 0, end = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&]
+                            { return stopping || generation != seen_generation; });
+            if (stopping)
+            {
+                return;
+            }
+            seen_generation = generation;
+            band = job;
+            band_range(job_begin, job_end, worker_id, num_threads, begin, end);
+        }
+
+        if (begin < end)
+        {
+            (*band)(begin, end);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+            {
+                work_done.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int begin, int end, const std::function<void(int, int)> &band)
+{
+    if (num_threads == 1)
+    {
+        if (begin < end)
+        {
+            band(begin, end);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &band;
+        job_begin = begin;
+        job_end = end;
+        pending = num_threads - 1;
+        ++generation;
+    }
+    work_ready.notify_all();
+
+    // the calling thread takes band 0
+    int first_begin, first_end;
+    band_range(begin, end, 0, num_threads, first_begin, first_end);
+    if (first_begin < first_end)
+    {
+        band(first_begin, first_end);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [&]
+                   { return pending == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,44 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that split a range of rows into one contiguous band per thread.
+// The calling thread works on the first band, so a pool of size 1 spawns no threads at all.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const { return num_threads; }
+
+    // call band(start, end) for disjoint bands covering [begin, end) and wait for all of them
+    void parallel_for(int begin, int end, const std::function<void(int, int)> &band);
+
+private:
+    void worker_loop(int worker_id);
+
+    int num_threads;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+
+    // current job, guarded by mutex
+    const std::function<void(int, int)> *job = nullptr;
+    int job_begin = 0;
+    int job_end = 0;
+    int generation = 0;
+    int pending = 0;
+    bool stopping = false;
+};
+
+#endif // __THREAD_POOL_HPP__
@@ -1,7 +1,4 @@
 #include "utils.hpp"
-#include "constants.hpp"
-
-using namespace constants;
 
 // Check if a directory exists
 bool directory_exists(const std::string &path)
@@ -44,6 +41,77 @@ void check_file_exist(const std::string &input_filepath)
     }
 }
 
+// Collect the images of a batch run: every image file of a directory, or the lines of a list file.
+// Leaves files empty when path is a single image.
+void get_image_files(const std::string &path, std::vector<std::string> &files)
+{
+    struct stat buffer;
+    if (stat(path.c_str(), &buffer) != 0)
+    {
+        return;
+    }
+
+    auto extension_of = [](const std::string &name)
+    {
+        size_t last_dot = name.find_last_of('.');
+        std::string extension = (last_dot != std::string::npos) ? name.substr(last_dot + 1) : "";
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return extension;
+    };
+
+    if (S_ISDIR(buffer.st_mode))
+    {
+        static const std::vector<std::string> image_extensions = {"png", "jpg", "jpeg", "bmp", "tif", "tiff", "webp", "ppm", "pgm"};
+
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr)
+        {
+            return;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr)
+        {
+            std::string name = entry->d_name;
+            if (std::find(image_extensions.begin(), image_extensions.end(), extension_of(name)) != image_extensions.end())
+            {
+                files.push_back(path + "/" + name);
+            }
+        }
+        closedir(dir);
+
+        std::sort(files.begin(), files.end());
+    }
+    else if (extension_of(path) == "txt" || extension_of(path) == "lst")
+    {
+        std::ifstream list(path);
+        std::string line;
+        while (std::getline(list, line))
+        {
+            if (!line.empty() && line[0] != '#')
+            {
+                files.push_back(line);
+            }
+        }
+    }
+}
+
+// videos are recognized by extension, image sequences by a printf-style pattern such as img_%04d.png
+bool is_video_input(const std::string &path)
+{
+    static const std::vector<std::string> video_extensions = {"mp4", "avi", "mov", "mkv", "webm", "m4v", "mpg", "mpeg"};
+
+    if (path.find('%') != std::string::npos)
+    {
+        return true;
+    }
+
+    size_t last_dot = path.find_last_of('.');
+    std::string extension = (last_dot != std::string::npos) ? path.substr(last_dot + 1) : "";
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return std::find(video_extensions.begin(), video_extensions.end(), extension) != video_extensions.end();
+}
+
 // reverse the characters used for ASCII art. This is used to get the negative of the ASCII image
 void reverse_string(std::string &str)
 {
@@ -56,15 +124,31 @@ void show_usage(const std::string &executable_name)
     std::cerr << "\nUsage: 'mpirun -np <INT>" << executable_name << " [options]' \n\n";
     std::cerr << "Options:\n"
                  "  -h, --help              Display this help message\n"
-                 "  -i, --input  <FILE>     Specify the path of the input image FILE (required)\n"
-                 "  -o, --output <STRING>   Specify the name of the output file (e.g. 'output')\m"
+                 "  -i, --input  <FILE>     Specify the input image FILE, a directory of images, a .txt list of images,\n"
+                 "                          a video or a numbered image sequence such as frames/img_%04d.png (required)\n"
+                 "  -o, --output <STRING>   Specify the name of the output file (e.g. 'output')\n"
                  "  -w, --width  <INT>      Set the width of the ASCII output; maintains aspect ratio\n"
                  "  -s, --chars  <STRING>   Define the set of characters used in the ASCII output\n"
                  "  -p, --print             Print the ASCII output to the console\n"
                  "  -n, --negate            Get the negative of the ASCII image\n"
                  "  -f, --factor  <FLOAT>   Set the scale factor from 0.1 to 1.0 (default) to resize the image\n"
                  "  -c, --color             Get ASCII PNG's in colors\n"
-                 "  -t, --threads <INT>     Set the number of threads to use, default is 256\n\n";
+                 "  -t, --threads <INT>     Set the number of threads per rank, default is 256 with CUDA, 1 otherwise\n"
+                 "  -r, --rec601            Weight R, G and B by Rec.601 luminance (default keeps the legacy weighting)\n"
+                 "  -d, --delta <FORMAT>    For videos, only render and write the cells that changed: 'ansi' or 'bin'\n"
+                 "  -a, --area              Average each cell's block of source pixels instead of resizing the image first\n"
+                 "  -m, --shape             Pick each character by the shape of its cell's pixels, not only their brightness;\n"
+                 "                          implies -a\n"
+                 "  -S, --stream            Decode PNG/PPM inputs in bands of rows so no rank holds the whole image; implies -a\n"
+                 "  -P, --profile           Time every phase on every rank and write min/max/mean to outputs/<output>_profile.json\n"
+                 "  -g, --grid              Also write the glyph and color of every cell to the binary outputs/<output>.grid\n"
+                 "  -F, --format <FORMAT>   Write the ASCII image as 'png' (default), 'ppm' (raw, fastest) or 'qoi' (fast, lossless)\n"
+                 "  -l, --listen <SOCKET>   Stay resident and convert jobs sent to the Unix socket SOCKET by out_client,\n"
+                 "                          on -t worker threads; -s, -f, -n, -c, -r, -a and -m are kept warm\n"
+                 "  -C, --cache <DIR>       Reuse the outputs of earlier runs on the same input bytes and options, kept in DIR\n"
+                 "      --cache-size <INT>  Evict the least recently used cached outputs above INT MiB, default 1024\n"
+                 "      --ansi[=MODE]       Print the ASCII output in color with 'truecolor' (default) or '256' color escapes\n"
+                 "      --png-level <INT>   Set the PNG compression level from 0 (none) to 9 (smallest), default is 1\n\n";
     std::cerr << "Example: 'mpirun -np 4 " << executable_name << " -i images/your_image.png -w 90 -c -p'\n\n";
 }
 
@@ -81,6 +165,18 @@ std::string get_basename(const std::string &full_path)
     return basename;
 }
 
+// split rows into nearly equal parts; the first (rows % num_parts) parts get one extra row
+std::pair<int, int> get_row_range(int rows, int part, int num_parts)
+{
+    int rows_per_part = rows / num_parts;
+    int remainder = rows % num_parts;
+
+    int start_row = part * rows_per_part + std::min(part, remainder);
+    int end_row = start_row + rows_per_part + (part < remainder ? 1 : 0);
+
+    return {start_row, end_row};
+}
+
 // calculate the dimensions of the block that multiply to the total number of threads
 std::pair<int, int> calculate_thread_dimensions(int thread_count)
 {
@@ -94,8 +190,15 @@ std::pair<int, int> calculate_thread_dimensions(int thread_count)
 }
 
 // parse the command line arguments and set the configuration
-void parse_arguments(int argc, char **argv, std::string &input_filepath, std::string &output_filepath, std::string &executable_name, bool &resize_flag, int &desired_width, bool &print_flag, bool &negate_flag, bool &colored_flag, bool &help_flag, int &thread_count)
+void parse_arguments(int argc, char **argv, std::string &input_filepath, std::string &output_filepath, std::string &executable_name, bool &resize_flag, int &desired_width, bool &print_flag, bool &negate_flag, bool &colored_flag, bool &rec601_flag, bool &area_flag, bool &shape_flag, bool &stream_flag, bool &profile_flag, bool &grid_flag, bool &help_flag, int &thread_count, std::string &delta_format, std::string &ansi_format, std::string &raster_format, int &png_level, std::string &characters, float &scale_factor, std::string &listen_path, std::string &cache_dir, long long &cache_bytes)
 {
+    // options with a long name only
+    enum
+    {
+        OPTION_CACHE_SIZE = CHAR_MAX + 1,
+        OPTION_ANSI,
+        OPTION_PNG_LEVEL
+    };
     struct option long_options[] = {
         {"help", no_argument, nullptr, 'h'},
         {"input", required_argument, nullptr, 'i'},
@@ -107,10 +210,23 @@ void parse_arguments(int argc, char **argv, std::string &input_filepath, std::st
         {"factor", required_argument, nullptr, 'f'},
         {"color", no_argument, nullptr, 'c'},
         {"threads", required_argument, nullptr, 't'},
+        {"rec601", no_argument, nullptr, 'r'},
+        {"delta", required_argument, nullptr, 'd'},
+        {"area", no_argument, nullptr, 'a'},
+        {"shape", no_argument, nullptr, 'm'},
+        {"stream", no_argument, nullptr, 'S'},
+        {"profile", no_argument, nullptr, 'P'},
+        {"grid", no_argument, nullptr, 'g'},
+        {"format", required_argument, nullptr, 'F'},
+        {"listen", required_argument, nullptr, 'l'},
+        {"cache", required_argument, nullptr, 'C'},
+        {"cache-size", required_argument, nullptr, OPTION_CACHE_SIZE},
+        {"ansi", optional_argument, nullptr, OPTION_ANSI},
+        {"png-level", required_argument, nullptr, OPTION_PNG_LEVEL},
         {0, 0, 0, 0}};
 
     int option;
-    const char *short_options = "hi:o:w:s:pnf:ct:";
+    const char *short_options = "hi:o:w:s:pnf:ct:rd:amSPgF:l:C:";
     while ((option = getopt_long(argc, argv, short_options, long_options, nullptr)) != EOF)
     {
         switch (option)
@@ -130,7 +246,7 @@ void parse_arguments(int argc, char **argv, std::string &input_filepath, std::st
             resize_flag = true;
             break;
         case 's':
-            CHARACTERS = optarg;
+            characters = optarg;
             break;
         case 'p':
             print_flag = true;
@@ -139,7 +255,7 @@ void parse_arguments(int argc, char **argv, std::string &input_filepath, std::st
             negate_flag = true;
             break;
         case 'f':
-            SCALE_FACTOR = std::atof(optarg);
+            scale_factor = std::atof(optarg);
             break;
         case 'c':
             colored_flag = true;
@@ -147,31 +263,131 @@ void parse_arguments(int argc, char **argv, std::string &input_filepath, std::st
         case 't':
             thread_count = std::atoi(optarg);
             break;
+        case 'r':
+            rec601_flag = true;
+            break;
+        case 'd':
+            delta_format = optarg;
+            break;
+        case 'a':
+            area_flag = true;
+            break;
+        case 'm':
+            shape_flag = true;
+            area_flag = true;
+            break;
+        case 'S':
+            stream_flag = true;
+            area_flag = true;
+            break;
+        case 'P':
+            profile_flag = true;
+            break;
+        case 'g':
+            grid_flag = true;
+            break;
+        case 'F':
+            raster_format = optarg;
+            break;
+        case 'l':
+            listen_path = optarg;
+            break;
+        case 'C':
+            cache_dir = optarg;
+            break;
+        case OPTION_CACHE_SIZE:
+        {
+            // the whole argument must be a number of MiB whose size in bytes fits; anything else is 0 and rejected below
+            char *end = nullptr;
+            long long mib = std::strtoll(optarg, &end, 10);
+            cache_bytes = (end != optarg && *end == '\0' && mib > 0 && mib <= (LLONG_MAX >> 20)) ? mib * (1LL << 20) : 0;
+            break;
+        }
+        case OPTION_ANSI:
+            ansi_format = optarg ? optarg : "truecolor";
+            print_flag = true;
+            break;
+        case OPTION_PNG_LEVEL:
+            png_level = std::atoi(optarg);
+            break;
         default:
             show_usage(executable_name);
         }
     }
 
     // make sure all inputs numbers are valid
+    if (cache_bytes <= 0)
+    {
+        std::cerr << "Error: The cache size must be a positive number of MiB.\n";
+        help_flag = true;
+    }
+
     if (desired_width <= 0 && resize_flag)
     {
         std::cerr << "Error: The width must be a positive integer.\n";
         help_flag = true;
     }
 
-    if (SCALE_FACTOR < 0.1 || SCALE_FACTOR > 1.0)
+    if (scale_factor < 0.1 || scale_factor > 1.0)
     {
         std::cerr << "Error: The scale factor must be between 0.1 and 1.0.\n";
         help_flag = true;
     }
 
+    if (!delta_format.empty() && delta_format != "ansi" && delta_format != "bin")
+    {
+        std::cerr << "Error: The delta format must be 'ansi' or 'bin'.\n";
+        help_flag = true;
+    }
+
+    if (!ansi_format.empty() && ansi_format != "truecolor" && ansi_format != "24bit" && ansi_format != "256")
+    {
+        std::cerr << "Error: The ANSI mode must be 'truecolor', '24bit' or '256'.\n";
+        help_flag = true;
+    }
+
+    if (raster_format != "png" && raster_format != "ppm" && raster_format != "qoi")
+    {
+        std::cerr << "Error: The image format must be 'png', 'ppm' or 'qoi'.\n";
+        help_flag = true;
+    }
+
+    if (png_level < 0 || png_level > 9)
+    {
+        std::cerr << "Error: The PNG level must be between 0 and 9.\n";
+        help_flag = true;
+    }
+
+    // glyph indices are stored in a single byte
+    if (characters.empty() || characters.size() > 256)
+    {
+        std::cerr << "Error: The character set must contain between 1 and 256 characters.\n";
+        help_flag = true;
+    }
+
     if (output_filepath.empty())
     {
         output_filepath = get_basename(input_filepath);
+
+        // numbered image sequences such as img_%04d.png are named after their prefix
+        size_t percent = output_filepath.find('%');
+        if (percent != std::string::npos)
+        {
+            output_filepath = output_filepath.substr(0, output_filepath.find_last_not_of("_-.", percent - 1) + 1);
+            if (percent == 0 || output_filepath.empty())
+            {
+                output_filepath = "frames";
+            }
+        }
     }
 
-    if (thread_count == 0)
+    // CUDA threads per block on the GPU build, worker threads per rank otherwise
+    if (thread_count <= 0)
     {
+#ifdef USE_GPU
         thread_count = 256;
+#else
+        thread_count = 1;
+#endif // USE_GPU
     }
 }
\ No newline at end of file
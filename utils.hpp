@@ -8,6 +8,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <cstdlib>
+#include <climits>
 #include <cstring>
 #include <algorithm>
 #include <getopt.h>
@@ -30,9 +31,12 @@ bool remove_file(const std::string &name);
 // Need to make sure we're writing to a new file and directory
 void check_file_exist(const std::string &output_filepath);
 
-// Get the list of image files in a directory
+// Get the list of image files in a directory, or the paths listed one per line in a .txt/.lst file
 void get_image_files(const std::string &path, std::vector<std::string> &files);
 
+// Check if the input is a video file or a printf-style numbered image sequence
+bool is_video_input(const std::string &path);
+
 // Reverse the characters used for ASCII art. This is used to get the negative of the ASCII image
 void reverse_string(std::string &str);
 
@@ -42,10 +46,13 @@ void show_usage(const std::string &executable_name);
 // Get the basename of a file, used to match the output file name with the input file name
 std::string get_basename(const std::string &full_path);
 
+// Get the [start, end) rows of part `part` when splitting `rows` rows into num_parts nearly equal parts
+std::pair<int, int> get_row_range(int rows, int part, int num_parts);
+
 // calculate the dimensions of the block that multiply to the total number of threads
 std::pair<int, int> calculate_thread_dimensions(int thread_count);
 
 // Parse the command line arguments and set the configuration
-void parse_arguments(int argc, char **argv, std::string &input_filepath, std::string &output_filepath, std::string &executable_name, bool &resize_flag, int &desired_width, bool &print_flag, bool &negate_flag, bool &colored_flag, bool &help_flag, int &thread_count);
+void parse_arguments(int argc, char **argv, std::string &input_filepath, std::string &output_filepath, std::string &executable_name, bool &resize_flag, int &desired_width, bool &print_flag, bool &negate_flag, bool &colored_flag, bool &rec601_flag, bool &area_flag, bool &shape_flag, bool &stream_flag, bool &profile_flag, bool &grid_flag, bool &help_flag, int &thread_count, std::string &delta_format, std::string &ansi_format, std::string &raster_format, int &png_level, std::string &characters, float &scale_factor, std::string &listen_path, std::string &cache_dir, long long &cache_bytes);
 
 #endif // __UTILS_HPP__
\ No newline at end of file
@@ -0,0 +1,257 @@
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "video.hpp"
+#include "bounded_queue.hpp"
+
+// frames in flight between two stages
+static const size_t VIDEO_QUEUE_DEPTH = 8;
+
+// one frame moving through the pipeline
+struct VideoFrame
+{
+    int index = 0;
+    cv::Mat image;
+    std::string ascii_art;
+};
+
+// seconds spent working (not waiting on a queue) by each stage
+struct StageTimes
+{
+    double decode = 0.0;
+    double resize = 0.0;
+    double convert = 0.0;
+    double encode = 0.0;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void convert_video(const std::string &input_filepath, const std::string &output_filepath, const RunContext &context, DeltaFormat delta_format)
+{
+    cv::VideoCapture capture(input_filepath);
+    if (!capture.isOpened())
+    {
+        throw std::runtime_error("Could not open the video: " + input_filepath);
+    }
+
+    double fps = capture.get(cv::CAP_PROP_FPS);
+    if (fps <= 0.0)
+    {
+        fps = 30.0;
+    }
+
+    const Converter &converter = *context.converter;
+    std::string color_output_string = (converter.config().colored_flag) ? "_color" : "";
+    std::string output_filepath_video = "outputs/" + output_filepath + color_output_string + ".avi";
+    const bool delta_flag = (delta_format != DELTA_NONE);
+    std::string text_extension = !delta_flag ? ".txt" : (delta_format == DELTA_ANSI) ? ".ansi" : ".delta";
+    std::ofstream text_stream("outputs/" + output_filepath + text_extension, std::ios::binary);
+    if (!delta_flag)
+    {
+        text_stream << context.command_line << "\n";
+    }
+
+    DeltaEncoder delta_encoder(converter.lut(), converter.atlas(), converter.atlas().characters, converter.config().colored_flag, delta_format);
+    std::string delta;
+    size_t changed_cells = 0, total_cells = 0;
+
+    BoundedQueue<VideoFrame> decoded(VIDEO_QUEUE_DEPTH);
+    BoundedQueue<VideoFrame> resized(VIDEO_QUEUE_DEPTH);
+    BoundedQueue<VideoFrame> converted(VIDEO_QUEUE_DEPTH);
+    StageTimes times;
+    int frame_count = 0;
+
+    // The first error of any stage closes every queue, so the other stages stop at their next push or drain
+    // what is left, and is rethrown on the calling thread once all of them are joined
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto fail = [&](std::exception_ptr stage_error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+            {
+                error = stage_error;
+            }
+        }
+        decoded.close();
+        resized.close();
+        converted.close();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread decode_stage([&]
+                             {
+        try
+        {
+            for (int index = 0;; ++index)
+            {
+                auto busy = std::chrono::steady_clock::now();
+                VideoFrame frame;
+                frame.index = index;
+                if (!capture.read(frame.image) || frame.image.empty())
+                {
+                    break;
+                }
+                times.decode += seconds_since(busy);
+
+                if (!decoded.push(std::move(frame)))
+                {
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+        decoded.close(); });
+
+    std::thread resize_stage([&]
+                             {
+        try
+        {
+            int desired_width = 0, desired_height = 0;
+            VideoFrame frame;
+            while (decoded.pop(frame))
+            {
+                auto busy = std::chrono::steady_clock::now();
+
+                // every frame gets the grid computed from the first one
+                if (desired_height == 0)
+                {
+                    desired_width = context.resize_flag ? context.desired_width : frame.image.cols;
+                    desired_height = (frame.image.rows * desired_width) / frame.image.cols;
+                    if (!delta_flag)
+                    {
+                        text_stream << "Dimensions: " << desired_width << "x" << desired_height << "\n\n";
+                    }
+                }
+                resize_image(frame.image, converter.grid_size(desired_width, desired_height));
+                times.resize += seconds_since(busy);
+
+                if (!resized.push(std::move(frame)))
+                {
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+        resized.close(); });
+
+    std::thread convert_stage([&]
+                              {
+        try
+        {
+            VideoFrame frame;
+            while (resized.pop(frame))
+            {
+                // delta frames are converted by the encoder, which owns the previous frame's state
+                if (delta_flag)
+                {
+                    if (!converted.push(std::move(frame)))
+                    {
+                        break;
+                    }
+                    continue;
+                }
+
+                auto busy = std::chrono::steady_clock::now();
+                std::pair<std::string, cv::Mat> process_output = converter.convert_rows(frame.image, *context.pool);
+                frame.ascii_art = std::move(process_output.first);
+                frame.image = process_output.second;
+                times.convert += seconds_since(busy);
+
+                if (!converted.push(std::move(frame)))
+                {
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+        converted.close(); });
+
+    // the calling thread encodes, since VideoWriter and the text stream are not shared with anyone
+    cv::VideoWriter writer;
+    try
+    {
+        VideoFrame frame;
+        while (converted.pop(frame))
+        {
+            auto busy = std::chrono::steady_clock::now();
+            if (delta_flag)
+            {
+                changed_cells += delta_encoder.encode(frame.image, frame.index, delta);
+                total_cells += frame.image.total();
+                frame.image = delta_encoder.canvas();
+
+                text_stream.write(delta.data(), delta.size());
+                delta.clear();
+            }
+
+            if (!writer.isOpened())
+            {
+                writer.open(output_filepath_video, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps, frame.image.size(), true);
+                if (!writer.isOpened())
+                {
+                    throw std::runtime_error("Could not open the video for writing: " + output_filepath_video);
+                }
+            }
+            writer.write(frame.image);
+
+            if (!delta_flag)
+            {
+                text_stream << "Frame " << frame.index << "\n";
+                text_stream.write(frame.ascii_art.data(), frame.ascii_art.size());
+                text_stream << "\n";
+            }
+            times.encode += seconds_since(busy);
+
+            ++frame_count;
+        }
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+
+    decode_stage.join();
+    resize_stage.join();
+    convert_stage.join();
+    writer.release();
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    double elapsed = seconds_since(start);
+
+    std::cout << "Converted " << frame_count << " frames in " << elapsed << " seconds: " << frame_count / elapsed << " frames/s\n";
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "  decode   busy " << times.decode << " s, queue max " << decoded.get_max_depth() << "/" << decoded.get_capacity() << " mean " << decoded.get_mean_depth() << "\n";
+    std::cout << "  resize   busy " << times.resize << " s, queue max " << resized.get_max_depth() << "/" << resized.get_capacity() << " mean " << resized.get_mean_depth() << "\n";
+    std::cout << "  convert  busy " << times.convert << " s, queue max " << converted.get_max_depth() << "/" << converted.get_capacity() << " mean " << converted.get_mean_depth() << "\n";
+    std::cout << "  encode   busy " << times.encode << " s\n";
+    if (delta_flag && total_cells > 0)
+    {
+        std::cout << "  delta    " << 100.0 * changed_cells / total_cells << "% of cells changed per frame\n";
+    }
+    std::cout << "ASCII video saved to " << output_filepath_video << " and outputs/" << output_filepath << text_extension << "\n";
+    std::cout.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,17 @@
+#ifndef __VIDEO_HPP__
+#define __VIDEO_HPP__
+
+#include <string>
+
+#include "image_processing.hpp"
+#include "delta.hpp"
+
+// Convert a video file or a numbered image sequence (e.g. frames/img_%04d.png) frame by frame.
+// Decoding, resizing, conversion and encoding run as concurrent stages joined by bounded queues.
+// Writes outputs/<output_filepath>.avi and all frames, one after the other, to outputs/<output_filepath>.txt,
+// then prints the sustained frame rate and the depth of every queue.
+// With a delta_format, only the cells that changed since the previous frame are rendered, and the
+// changes are written to outputs/<output_filepath>.ansi or .delta instead of the .txt.
+void convert_video(const std::string &input_filepath, const std::string &output_filepath, const RunContext &context, DeltaFormat delta_format);
+
+#endif // __VIDEO_HPP__